@@ -0,0 +1,732 @@
+#include "hashmap.h"
+#include "hm_concurrent.h"
+#include "hm_ctrl.h"
+#include "hm_sharded.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+* Throughput and latency of hashmap operations, printed as JSON to stdout.
+*
+* Every configuration is a key size, a load factor the table is filled to (capacity is set exactly,
+* so nothing grows while measuring), a key distribution of lookups and updates,
+* and a number of mappings. Latency percentiles are taken over batches of `LATENCY_BATCH`
+* operations, timing single calls would mostly measure the clock.
+*
+* Thread scaling is measured last: throughput of 1 to 8 threads doing lookups (and lookups mixed
+* with upserts) on a sharded map, a concurrent map (lookups only, it has a single writer)
+* and a plain map behind one mutex as the baseline.
+*
+* Usage: hm_bench [--quick] [--max-count N] [--ops N]
+*/
+
+#define LATENCY_BATCH 32
+#define ZIPF_EXPONENT 0.99
+#define DEFAULT_OPS (1u << 20)
+#define SCALING_COUNT (1u << 16)
+#define SCALING_KEY_SIZE 8
+#define SCALING_SHARDS 64
+#define SCALING_UPDATE_EVERY 10 /* every 10th operation of the mixed workload is an upsert */
+
+typedef enum distribution
+{
+    UNIFORM,
+    ZIPFIAN
+}
+distribution_t;
+
+typedef struct config
+{
+    size_t key_size;
+    float load_factor;
+    size_t count;
+    size_t ops;
+}
+config_t;
+
+typedef struct result
+{
+    const char *op;
+    distribution_t dist;
+    size_t ops;
+    double seconds;
+    double *batch_ns; /* ns per operation of each batch, NULL - no percentiles */
+    size_t batches;
+}
+result_t;
+
+static const size_t key_sizes[] = {4, 8, 16, 64};
+static const float load_factors[] = {0.25f, 0.5f, 0.75f, 0.9f};
+static const size_t counts[] = {1u << 10, 1u << 14, 1u << 18, 1u << 22};
+static const size_t quick_counts[] = {1u << 10, 1u << 14};
+static const size_t thread_counts[] = {1, 2, 4, 8};
+
+typedef enum scaling_kind
+{
+    MUTEX,
+    SHARDED,
+    CONCURRENT
+}
+scaling_kind_t;
+
+static const char *const scaling_names[] = {"mutex", "sharded", "concurrent"};
+
+typedef struct scaling_target
+{
+    scaling_kind_t kind;
+    hashmap_t *map; /* MUTEX */
+    pthread_mutex_t lock;
+    hm_sharded_t *sharded;
+    hm_concurrent_t *concurrent;
+}
+scaling_target_t;
+
+typedef struct scaling_task
+{
+    pthread_t thread;
+    scaling_target_t *target;
+    hm_reader_t *reader; /* CONCURRENT */
+    const char *keys;
+    size_t *indices;
+    size_t ops;
+    bool mixed;
+    uint64_t acc;
+}
+scaling_task_t;
+
+static volatile uint64_t sink;
+static bool first_result = true;
+
+/***                          ***
+* === forward declarations  === *
+***                          ***/
+
+static hash_t hash_bytes(const void *const data, const size_t size);
+static uint64_t mix64(uint64_t x);
+static uint64_t next_random(uint64_t *const state);
+static void make_key(char *const key, const size_t key_size, const uint64_t index);
+static char *make_keys(const size_t key_size, const size_t first, const size_t n);
+static size_t *make_indices(const distribution_t dist, const size_t count, const size_t n, uint64_t *const seed);
+static double now(void);
+static int compare_doubles(const void *a, const void *b);
+static double percentile(const double *const sorted, const size_t n, const double p);
+
+static void run_config(const config_t *const config);
+static void run_scaling(const size_t ops);
+static bool scaling_fill(scaling_target_t *const target, const char *const keys);
+static void scaling_release(scaling_target_t *const target);
+static void *scaling_worker(void *const arg);
+static void print_meta(const int argc, char **const argv);
+static void print_result(const config_t *const config, result_t *const result);
+static void print_scaling(const scaling_target_t *const target, const bool mixed, const size_t threads,
+        const size_t ops, const double seconds);
+
+/***                  ***
+* === entry point === *
+***                  ***/
+
+int main(int argc, char **argv)
+{
+    size_t max_count = SIZE_MAX;
+    size_t ops = DEFAULT_OPS;
+    const size_t *sizes = counts;
+    size_t nsizes = sizeof(counts) / sizeof(*counts);
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (0 == strcmp(argv[i], "--quick"))
+        {
+            sizes = quick_counts;
+            nsizes = sizeof(quick_counts) / sizeof(*quick_counts);
+            ops = DEFAULT_OPS / 16;
+        }
+        else if (0 == strcmp(argv[i], "--max-count") && i + 1 < argc)
+        {
+            max_count = strtoull(argv[++i], NULL, 10);
+        }
+        else if (0 == strcmp(argv[i], "--ops") && i + 1 < argc)
+        {
+            ops = strtoull(argv[++i], NULL, 10);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--quick] [--max-count N] [--ops N]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (ops < LATENCY_BATCH) ops = LATENCY_BATCH;
+
+    print_meta(argc, argv);
+
+    for (size_t s = 0; s < nsizes && sizes[s] <= max_count; ++s)
+    {
+        for (size_t k = 0; k < sizeof(key_sizes) / sizeof(*key_sizes); ++k)
+        {
+            for (size_t l = 0; l < sizeof(load_factors) / sizeof(*load_factors); ++l)
+            {
+                const config_t config = {
+                    .key_size = key_sizes[k],
+                    .load_factor = load_factors[l],
+                    .count = sizes[s],
+                    .ops = ops,
+                };
+                run_config(&config);
+            }
+        }
+    }
+
+    run_scaling(ops / 4);
+
+    printf("\n  ]\n}\n");
+    return EXIT_SUCCESS;
+}
+
+/***                     ***
+* === static functions === *
+***                     ***/
+
+/*
+* Word at a time multiply-xorshift hash, the same for every key size.
+*/
+static hash_t hash_bytes(const void *const data, const size_t size)
+{
+    const unsigned char *bytes = data;
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ size;
+    size_t i = 0;
+
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        h = (h ^ mix64(word)) * 0xbf58476d1ce4e5b9ull;
+    }
+    if (i < size)
+    {
+        uint64_t word = 0;
+        memcpy(&word, bytes + i, size - i);
+        h = (h ^ mix64(word)) * 0xbf58476d1ce4e5b9ull;
+    }
+
+    return (hash_t)mix64(h);
+}
+
+
+/*
+* splitmix64 finalizer, a bijection of 64-bit words.
+*/
+static uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+
+static uint64_t next_random(uint64_t *const state)
+{
+    *state += 0x9e3779b97f4a7c15ull;
+    return mix64(*state);
+}
+
+
+/*
+* Distinct indices give distinct keys for every key size:
+* the first word is a bijection of the index (of its low 32 bits for 4 byte keys).
+*/
+static void make_key(char *const key, const size_t key_size, const uint64_t index)
+{
+    if (4 == key_size)
+    {
+        uint32_t word = (uint32_t)index * 0x9e3779b1u;
+        memcpy(key, &word, sizeof(word));
+        return;
+    }
+
+    for (size_t offset = 0; offset < key_size; offset += 8)
+    {
+        const uint64_t word = mix64(index + offset * 0x100000000ull);
+        memcpy(key + offset, &word, (key_size - offset < 8) ? key_size - offset : 8);
+    }
+}
+
+
+static char *make_keys(const size_t key_size, const size_t first, const size_t n)
+{
+    char *keys = malloc(n * key_size);
+    if (!keys) return NULL;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        make_key(keys + i * key_size, key_size, first + i);
+    }
+    return keys;
+}
+
+
+/*
+* Key indices of `n` accesses, zipfian ranks are drawn through the inverted CDF.
+*/
+static size_t *make_indices(const distribution_t dist, const size_t count, const size_t n, uint64_t *const seed)
+{
+    size_t *indices = malloc(n * sizeof(size_t));
+    double *cdf = (ZIPFIAN == dist) ? malloc(count * sizeof(double)) : NULL;
+
+    if (!indices || (ZIPFIAN == dist && !cdf))
+    {
+        free(indices);
+        free(cdf);
+        return NULL;
+    }
+
+    if (cdf)
+    {
+        double sum = 0.0;
+        for (size_t r = 0; r < count; ++r)
+        {
+            sum += 1.0 / pow((double)(r + 1), ZIPF_EXPONENT);
+            cdf[r] = sum;
+        }
+        for (size_t r = 0; r < count; ++r)
+        {
+            cdf[r] /= sum;
+        }
+    }
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        const uint64_t random = next_random(seed);
+
+        if (!cdf)
+        {
+            indices[i] = random % count;
+            continue;
+        }
+
+        const double u = (double)(random >> 11) / (double)(1ull << 53);
+        size_t lo = 0, hi = count - 1;
+        while (lo < hi)
+        {
+            const size_t mid = lo + (hi - lo) / 2;
+            if (cdf[mid] < u) lo = mid + 1;
+            else hi = mid;
+        }
+        indices[i] = lo;
+    }
+
+    free(cdf);
+    return indices;
+}
+
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+
+static int compare_doubles(const void *a, const void *b)
+{
+    const double x = *(const double*)a;
+    const double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+
+static double percentile(const double *const sorted, const size_t n, const double p)
+{
+    const size_t index = (size_t)(p * (double)(n - 1) + 0.5);
+    return sorted[index];
+}
+
+
+/*
+* Times `n` calls of the statement in batches, `i` is the number of the call.
+*/
+#define MEASURE(result, n, stmt) \
+    do { \
+        (result)->batches = (n) / LATENCY_BATCH; \
+        (result)->ops = (result)->batches * LATENCY_BATCH; \
+        (result)->batch_ns = malloc((result)->batches * sizeof(double)); \
+        const double start_ = now(); \
+        double last_ = start_; \
+        for (size_t b_ = 0; b_ < (result)->batches; ++b_) \
+        { \
+            for (size_t i = b_ * LATENCY_BATCH; i < (b_ + 1) * LATENCY_BATCH; ++i) \
+            { \
+                stmt; \
+            } \
+            const double t_ = now(); \
+            if ((result)->batch_ns) (result)->batch_ns[b_] = (t_ - last_) * 1e9 / LATENCY_BATCH; \
+            last_ = t_; \
+        } \
+        (result)->seconds = last_ - start_; \
+    } while (0)
+
+
+static void run_config(const config_t *const config)
+{
+    const size_t key_size = config->key_size;
+    const size_t count = config->count;
+    const size_t ops = config->ops;
+    uint64_t seed = 0x5eed ^ count ^ key_size << 32;
+
+    char *keys = make_keys(key_size, 0, count);
+    char *missing = make_keys(key_size, count, ops < count ? ops : count);
+    size_t *uniform = make_indices(UNIFORM, count, ops, &seed);
+    size_t *zipfian = make_indices(ZIPFIAN, count, ops, &seed);
+    const size_t nmissing = ops < count ? ops : count;
+
+    hashmap_t *map = hm_create(
+        .key_size = key_size,
+        .value_size = sizeof(uint64_t),
+        .hashfunc = hash_bytes,
+        .capacity = (size_t)(count / config->load_factor) + 1,
+        .capacity_policy = HM_CAPACITY_EXACT,
+        .max_load_factor = 0.95f
+    );
+
+    if (!keys || !missing || !uniform || !zipfian || !map)
+    {
+        fprintf(stderr, "hm_bench: out of memory at %zu mappings of %zu byte keys\n", count, key_size);
+        exit(EXIT_FAILURE);
+    }
+
+    result_t result = {0};
+    uint64_t acc = 0;
+
+    result = (result_t){ .op = "insert" };
+    MEASURE(&result, count, hm_insert(&map, keys + i * key_size, &(uint64_t){i}));
+    print_result(config, &result);
+
+    const distribution_t dists[] = {UNIFORM, ZIPFIAN};
+    for (size_t d = 0; d < 2; ++d)
+    {
+        const size_t *indices = (UNIFORM == dists[d]) ? uniform : zipfian;
+
+        result = (result_t){ .op = "get_hit", .dist = dists[d] };
+        MEASURE(&result, ops, acc += *(const uint64_t*)hm_get(map, keys + indices[i] * key_size));
+        print_result(config, &result);
+
+        result = (result_t){ .op = "upsert", .dist = dists[d] };
+        MEASURE(&result, ops, hm_upsert(&map, keys + indices[i] * key_size, &(uint64_t){i}));
+        print_result(config, &result);
+    }
+
+    result = (result_t){ .op = "get_miss" };
+    MEASURE(&result, ops, acc += (NULL != hm_get(map, missing + (i % nmissing) * key_size)));
+    print_result(config, &result);
+
+    /* whole traversals, reported per mapping */
+    const size_t rounds = (ops + count - 1) / count;
+    result = (result_t){ .op = "iterate" };
+    const double iterate_start = now();
+    for (size_t r = 0; r < rounds; ++r)
+    {
+        hm_iter_t it = hm_iter(map);
+        void *value;
+        while (hm_iter_next(&it, NULL, &value)) acc += *(const uint64_t*)value;
+    }
+    result.seconds = now() - iterate_start;
+    result.ops = rounds * count;
+    print_result(config, &result);
+
+    /* every mapping is placed into a new table, reported per mapping */
+    result = (result_t){ .op = "rehash" };
+    const double rehash_start = now();
+    hm_shrink_reserve(&map, 1.0f / config->load_factor - 1.0f);
+    result.seconds = now() - rehash_start;
+    result.ops = count;
+    print_result(config, &result);
+
+    result = (result_t){ .op = "remove" };
+    MEASURE(&result, count, hm_remove(map, keys + i * key_size));
+    print_result(config, &result);
+
+    sink = acc;
+
+    hm_destroy(map);
+    free(keys);
+    free(missing);
+    free(uniform);
+    free(zipfian);
+}
+
+
+/*
+* Every thread does `ops` uniformly distributed operations on its own key sequence,
+* throughput is taken from the start of the first thread to the end of the last one.
+*/
+static void run_scaling(const size_t ops)
+{
+    char *keys = make_keys(SCALING_KEY_SIZE, 0, SCALING_COUNT);
+    scaling_task_t tasks[8];
+    uint64_t seed = 0x5ca1e;
+
+    if (!keys)
+    {
+        fprintf(stderr, "hm_bench: out of memory for scaling keys\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(*thread_counts); ++t)
+    {
+        const size_t threads = thread_counts[t];
+
+        for (int kind = MUTEX; kind <= CONCURRENT; ++kind)
+        {
+            for (int mixed = 0; mixed < 2; ++mixed)
+            {
+                /* concurrent map takes writes from a single thread only */
+                if (mixed && CONCURRENT == kind) continue;
+
+                scaling_target_t target = { .kind = kind };
+                if (!scaling_fill(&target, keys))
+                {
+                    fprintf(stderr, "hm_bench: out of memory for %s map\n", scaling_names[kind]);
+                    exit(EXIT_FAILURE);
+                }
+
+                for (size_t i = 0; i < threads; ++i)
+                {
+                    tasks[i] = (scaling_task_t){
+                        .target = &target,
+                        .reader = (CONCURRENT == kind) ? hm_reader_register(target.concurrent) : NULL,
+                        .keys = keys,
+                        .indices = make_indices(UNIFORM, SCALING_COUNT, ops, &seed),
+                        .ops = ops,
+                        .mixed = mixed,
+                    };
+                    if (!tasks[i].indices)
+                    {
+                        fprintf(stderr, "hm_bench: out of memory for scaling indices\n");
+                        exit(EXIT_FAILURE);
+                    }
+                }
+
+                const double start = now();
+                for (size_t i = 0; i < threads; ++i)
+                {
+                    if (0 != pthread_create(&tasks[i].thread, NULL, scaling_worker, &tasks[i]))
+                    {
+                        fprintf(stderr, "hm_bench: can't start thread %zu\n", i);
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                for (size_t i = 0; i < threads; ++i)
+                {
+                    pthread_join(tasks[i].thread, NULL);
+                }
+                const double seconds = now() - start;
+
+                print_scaling(&target, mixed, threads, threads * ops, seconds);
+
+                for (size_t i = 0; i < threads; ++i)
+                {
+                    sink += tasks[i].acc;
+                    if (tasks[i].reader) hm_reader_unregister(tasks[i].reader);
+                    free(tasks[i].indices);
+                }
+                scaling_release(&target);
+            }
+        }
+    }
+
+    free(keys);
+}
+
+
+/*
+* Creates the map of the target kind holding `SCALING_COUNT` keys.
+*/
+static bool scaling_fill(scaling_target_t *const target, const char *const keys)
+{
+    switch (target->kind)
+    {
+        case MUTEX:
+            target->map = hm_create(
+                .key_size = SCALING_KEY_SIZE,
+                .value_size = sizeof(uint64_t),
+                .hashfunc = hash_bytes
+            );
+            if (!target->map || 0 != pthread_mutex_init(&target->lock, NULL)) return false;
+            break;
+
+        case SHARDED:
+            target->sharded = hm_sharded_create(SCALING_SHARDS,
+                .key_size = SCALING_KEY_SIZE,
+                .value_size = sizeof(uint64_t),
+                .hashfunc = hash_bytes
+            );
+            if (!target->sharded) return false;
+            break;
+
+        case CONCURRENT:
+            target->concurrent = hm_concurrent_create(
+                .key_size = SCALING_KEY_SIZE,
+                .value_size = sizeof(uint64_t),
+                .hashfunc = hash_bytes
+            );
+            if (!target->concurrent) return false;
+            break;
+    }
+
+    for (uint64_t i = 0; i < SCALING_COUNT; ++i)
+    {
+        const char *key = keys + i * SCALING_KEY_SIZE;
+        hm_status_t status = HM_SUCCESS;
+
+        switch (target->kind)
+        {
+            case MUTEX: status = hm_insert(&target->map, key, &i); break;
+            case SHARDED: status = hm_sharded_insert(target->sharded, key, &i); break;
+            case CONCURRENT: status = hm_concurrent_insert(target->concurrent, key, &i); break;
+        }
+        if (HM_SUCCESS != status) return false;
+    }
+
+    return true;
+}
+
+
+static void scaling_release(scaling_target_t *const target)
+{
+    switch (target->kind)
+    {
+        case MUTEX:
+            hm_destroy(target->map);
+            pthread_mutex_destroy(&target->lock);
+            break;
+        case SHARDED: hm_sharded_destroy(target->sharded); break;
+        case CONCURRENT: hm_concurrent_destroy(target->concurrent); break;
+    }
+}
+
+
+static void *scaling_worker(void *const arg)
+{
+    scaling_task_t *task = arg;
+    scaling_target_t *target = task->target;
+    uint64_t acc = 0;
+
+    for (size_t i = 0; i < task->ops; ++i)
+    {
+        const char *key = task->keys + task->indices[i] * SCALING_KEY_SIZE;
+        const bool update = task->mixed && 0 == i % SCALING_UPDATE_EVERY;
+        uint64_t value = i;
+
+        switch (target->kind)
+        {
+            case MUTEX:
+                pthread_mutex_lock(&target->lock);
+                if (update)
+                {
+                    hm_upsert(&target->map, key, &value);
+                }
+                else
+                {
+                    const uint64_t *stored = hm_get(target->map, key);
+                    if (stored) acc += *stored;
+                }
+                pthread_mutex_unlock(&target->lock);
+                break;
+
+            case SHARDED:
+                if (update) hm_sharded_upsert(target->sharded, key, &value);
+                else if (hm_sharded_get(target->sharded, key, &value)) acc += value;
+                break;
+
+            case CONCURRENT:
+                if (hm_concurrent_get(task->reader, key, &value)) acc += value;
+                break;
+        }
+    }
+
+    task->acc = acc;
+    return NULL;
+}
+
+
+static void print_meta(const int argc, char **const argv)
+{
+    printf("{\n  \"meta\": {\n");
+    printf("    \"format\": 2,\n");
+    printf("    \"timestamp\": %lld,\n", (long long)time(NULL));
+#ifdef __VERSION__
+    printf("    \"compiler\": \"%s\",\n", __VERSION__);
+#endif
+    printf("    \"group_width\": %d,\n", HM_GROUP_WIDTH);
+    printf("    \"latency_batch\": %d,\n", LATENCY_BATCH);
+    printf("    \"zipf_exponent\": %.2f,\n", ZIPF_EXPONENT);
+    printf("    \"args\": [");
+    for (int i = 1; i < argc; ++i)
+    {
+        printf("%s\"%s\"", (i > 1) ? ", " : "", argv[i]);
+    }
+    printf("]\n  },\n  \"results\": [");
+}
+
+
+/*
+* One JSON object per line, percentiles are null for operations timed as a whole.
+*/
+static void print_result(const config_t *const config, result_t *const result)
+{
+    const double ns_per_op = result->ops ? result->seconds * 1e9 / (double)result->ops : 0.0;
+
+    printf("%s\n    {\"op\": \"%s\", \"key_size\": %zu, \"load_factor\": %.2f, \"distribution\": \"%s\", "
+            "\"count\": %zu, \"ops\": %zu, \"mops\": %.3f, \"ns_per_op\": %.2f",
+            first_result ? "" : ",",
+            result->op, config->key_size, config->load_factor,
+            (ZIPFIAN == result->dist) ? "zipfian" : "uniform",
+            config->count, result->ops,
+            result->seconds > 0.0 ? (double)result->ops / result->seconds * 1e-6 : 0.0,
+            ns_per_op);
+
+    if (result->batch_ns && result->batches)
+    {
+        qsort(result->batch_ns, result->batches, sizeof(double), compare_doubles);
+        printf(", \"p50_ns\": %.2f, \"p90_ns\": %.2f, \"p99_ns\": %.2f, \"p999_ns\": %.2f}",
+                percentile(result->batch_ns, result->batches, 0.5),
+                percentile(result->batch_ns, result->batches, 0.9),
+                percentile(result->batch_ns, result->batches, 0.99),
+                percentile(result->batch_ns, result->batches, 0.999));
+    }
+    else
+    {
+        printf(", \"p50_ns\": null, \"p90_ns\": null, \"p99_ns\": null, \"p999_ns\": null}");
+    }
+
+    free(result->batch_ns);
+    result->batch_ns = NULL;
+    first_result = false;
+}
+
+
+/*
+* Scaling results carry the map kind and thread count instead of table configuration.
+*/
+static void print_scaling(const scaling_target_t *const target, const bool mixed, const size_t threads,
+        const size_t ops, const double seconds)
+{
+    printf("%s\n    {\"op\": \"%s\", \"map\": \"%s\", \"threads\": %zu, \"key_size\": %d, "
+            "\"count\": %u, \"ops\": %zu, \"mops\": %.3f, \"ns_per_op\": %.2f}",
+            first_result ? "" : ",",
+            mixed ? "scaling_mixed" : "scaling_get", scaling_names[target->kind], threads,
+            SCALING_KEY_SIZE, SCALING_COUNT, ops,
+            seconds > 0.0 ? (double)ops / seconds * 1e-6 : 0.0,
+            ops ? seconds * 1e9 / (double)ops : 0.0);
+
+    first_result = false;
+}
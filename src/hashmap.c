@@ -1,52 +1,108 @@
 #include "hashmap.h"
-#include "bitset.h"
+#include "hm_internal.h"
 #include "vector.h"
 #include <assert.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-#define ALIGNMENT sizeof(size_t)
-#define BIT_FIELD_LEN 2
-#define LARGE_PRIME 0x7fffffffu
+#if defined(__linux__)
+#   include <sys/random.h>
+#endif
 
-typedef struct hm_header
-{
-    alloc_opts_t alloc_opts;
-    size_t key_size;
-    size_t aligned_key_size;
-    size_t value_size;
-    hashfunc_t hashfunc;
-
-    unsigned int a; /* random factors for multiplicative hashing */
-    unsigned int b;
-    char usage_tbl[];
-}
-hm_header_t;
+#define ALIGNMENT HM_SLOT_ALIGNMENT
+#define MIN_CAPACITY HM_GROUP_WIDTH
+#define BATCH_SIZE 16 /* lookups in flight for batched access */
+#define ARENA_BLOCK_SIZE 4096
+#define PARALLEL_MIN_COUNT 65536 /* mappings worth placing by several threads */
+#define PAGED_MIN_SIZE (2u << 20) /* tables below a huge page ignore page and memory policies */
 
-typedef enum hm_slot_status
+/*
+* Bump allocated storage of variable length keys,
+* blocks never move so stored keys point right into them.
+*/
+typedef struct arena_block
 {
-    HM_SLOT_UNUSED = 0,
-    HM_SLOT_USED,
-    HM_SLOT_DELETED
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+    char data[];
 }
-hm_slot_status_t;
+arena_block_t;
+
 
 /***                          ***
 * === forward declarations  === *
 ***                          ***/
 
-static size_t calc_usage_tbl_size(const size_t capacity);
+static size_t calc_ctrl_size(const size_t capacity);
+static size_t calc_dist_size(const size_t capacity, const hm_probing_t probing);
+static size_t calc_capacity(const size_t capacity, const hm_capacity_policy_t policy);
+static size_t calc_growth_limit(const size_t capacity, const float max_load_factor);
+static size_t calc_min_capacity(const size_t count, const float max_load_factor);
+static size_t calc_slot_size(const hm_opts_t *const opts);
+static void init_header(hm_header_t *const header, const hm_opts_t *const opts, const size_t capacity);
 
 static hm_header_t *get_hm_header(const hashmap_t *const map);
-
-static size_t hash_to_index(const hm_header_t *header, const hash_t hash, const size_t capacity);
+static hash_t key_hash(const hm_header_t *const header, const void *const key);
+static uint8_t *get_dist(hm_header_t *const header, const size_t capacity);
+
+static void set_ctrl(hm_header_t *const header, const size_t index, const size_t capacity, const ctrl_t ctrl);
+
+static size_t find_index(const hashmap_t *const map, const void *const key, const hash_t hash, hm_header_t *const stats);
+static void probe_start(hm_probe_t *const probe, const hashmap_t *const table, hm_header_t *const stats);
+static void probe_load(hm_probe_t *const probe, const hm_header_t *const header, hm_header_t *const stats);
+static size_t probe_next_index(hm_probe_t *const probe, const hm_header_t *const header, hm_header_t *const stats);
+static void *find_value(const hashmap_t *const map, const void *const key, const hash_t hash, hm_header_t *const stats);
+static void prefetch_home(const hashmap_t *const map, const hash_t hash);
+static size_t lookup_batch(const hashmap_t *const map, const char *keys, const size_t n,
+        void **const values_out, bool *const found_out);
+static bool slot_matches(const hashmap_t *const map, const size_t index, const void *const key, const hash_t hash,
+        hm_header_t *const stats);
+static hash_t slot_hash(const hashmap_t *const map, const size_t index);
+static size_t place_slot(hashmap_t *const map, const char *const slot, const hash_t hash);
+static bool place_all(hashmap_t *const dst, const hashmap_t *const src);
+static size_t find_free_index(const hm_header_t *const header, const uint64_t mixed, const size_t capacity);
+static void erase_index(hashmap_t *const map, const size_t index);
+static hm_status_t reserve_hashed(hashmap_t **const map, const void *const key, const hash_t hash, void **const value_out);
+static hm_status_t insert_hashed(hashmap_t **const map, const void *const key, const hash_t hash, void **const value_out);
+static void claim_slot(hm_header_t *const header, const size_t index, const size_t capacity, const uint64_t mixed);
+
+static size_t rh_find_index(const hashmap_t *const map, const void *const key, const hash_t hash, hm_header_t *const stats);
+static size_t rh_make_room(hashmap_t *const map, const uint64_t mixed);
+static void rh_erase_index(hashmap_t *const map, size_t index);
+static void move_slot(hashmap_t *const map, const size_t to, const size_t from);
+static void swap_slots(hashmap_t *const map, const size_t a, const size_t b);
+static size_t probe_group(const hm_header_t *header, const size_t home, const size_t index, const size_t capacity);
 static void set_key(hashmap_t *const map, void *const stored_key, const void *const key);
 static void set_value(hashmap_t *const map, void *const stored_value, const void *const value);
 static char *get_key(const hashmap_t *const map, const size_t index);
 static char *get_value(const hashmap_t *const map, const size_t index);
 
+static bool intern_key(hm_header_t *const header, const hm_key_t *const key, hm_key_t *const interned);
+static hm_status_t arena_rebase(hashmap_t *const map);
+static void arena_adopt(hm_header_t *const header, hm_header_t *const from);
+static void arena_free(hm_header_t *const header);
+static void arena_reset(hm_header_t *const header);
+
+static uint64_t used_slots(const hm_header_t *const header, const size_t base, const size_t capacity);
+
 static void randomize_factors(hm_header_t *const header);
+static void inherit_stats(hm_header_t *const header, const hm_header_t *const from);
+static void table_stats(const hashmap_t *const table, hm_stats_t *const out, double *const probe_sum);
+static size_t table_bytes(const hashmap_t *const table);
+static size_t probe_bucket(const size_t distance);
+static hashmap_t *create_paged(const hm_opts_t *const opts, const size_t capacity);
+static hashmap_t *create_like(const hashmap_t *const map, const size_t capacity);
 static hm_status_t rehash(hashmap_t **const map, const size_t new_cap);
+static bool parallel_placement(const hm_header_t *const header, const size_t count);
+
+static hm_status_t start_migration(hashmap_t **const map);
+static void migrate_step(hashmap_t *const map);
+static bool migrate_slot(hashmap_t *const map, const size_t index);
+static hm_status_t finish_migration(hashmap_t **const map);
 
 /***                       ***
 * === API implementation === *
@@ -55,19 +111,27 @@ static hm_status_t rehash(hashmap_t **const map, const size_t new_cap);
 hashmap_t *hm_create_(const hm_opts_t *const opts)
 {
     assert(opts);
-    assert(opts->key_size && "key_size wasn't provided");
+    assert((opts->key_size || opts->var_keys) && "key_size wasn't provided");
     assert(opts->value_size && "value_size wasn't provided");
-    assert(opts->hashfunc && "hashfunc wasn't provided");
+    assert(opts->max_load_factor > 0.0f && opts->max_load_factor <= 1.0f
+            && "max_load_factor must be in (0, 1]");
 
-    const size_t aligned_key_size = calc_aligned_size(opts->key_size, ALIGNMENT);
-    const size_t aligned_value_size = calc_aligned_size(opts->value_size, ALIGNMENT);
-    const size_t usage_tbl_size = calc_usage_tbl_size(opts->capacity);
+    const size_t capacity = calc_capacity(opts->capacity, opts->capacity_policy);
+    const size_t ctrl_size = calc_ctrl_size(capacity);
+    const size_t dist_size = calc_dist_size(capacity, opts->probing);
+
+    /* vector storage is the fallback when policies can't be applied */
+    if (HM_PAGES_DEFAULT != opts->pages || HM_NUMA_DEFAULT != opts->numa)
+    {
+        hashmap_t *map = create_paged(opts, capacity);
+        if (map) return map;
+    }
 
     /* allocate storage for hashmap */
     hashmap_t *map = vector_create(
-        .ext_header_size = sizeof(hm_header_t) + usage_tbl_size,
-        .initial_cap = opts->capacity,
-        .element_size = aligned_key_size + aligned_value_size,
+        .ext_header_size = sizeof(hm_header_t) + ctrl_size + dist_size,
+        .initial_cap = capacity,
+        .element_size = calc_slot_size(opts),
         .alloc_opts = opts->alloc_opts,
     );
 
@@ -75,17 +139,70 @@ hashmap_t *hm_create_(const hm_opts_t *const opts)
 
     /* initializing hashmap related data */
     hm_header_t *header = get_hm_header(map);
+    init_header(header, opts, capacity);
+    header->ctrl = (ctrl_t*)(header + 1);
+    header->slots = vector_get(map, 0);
 
-    *header = (hm_header_t){
+    memset(header->ctrl, HM_CTRL_EMPTY, ctrl_size);
+    memset(get_dist(header, capacity), 0, dist_size);
+    randomize_factors(header);
+
+    return map;
+}
+
+
+hashmap_t *hm_create_mapped_(const hm_opts_t *const opts, const size_t capacity,
+        ctrl_t *const ctrl, char *const slots)
+{
+    assert(opts);
+    assert(ctrl);
+    assert(slots);
+
+    /* storage of the vector itself is left unused */
+    hashmap_t *map = vector_create(
+        .ext_header_size = sizeof(hm_header_t),
+        .initial_cap = 1,
+        .element_size = calc_slot_size(opts),
         .alloc_opts = opts->alloc_opts,
-        .key_size = opts->key_size,
-        .aligned_key_size = aligned_key_size,
-        .value_size = opts->value_size,
-        .hashfunc = opts->hashfunc,
-    };
+    );
 
-    bitset_init(header->usage_tbl, usage_tbl_size);
-    randomize_factors(header);
+    if (!map) return NULL;
+
+    hm_header_t *header = get_hm_header(map);
+    init_header(header, opts, capacity);
+    header->ctrl = ctrl;
+    header->slots = slots;
+
+    return map;
+}
+
+
+hashmap_t *hm_build_from_(const hm_opts_t *const opts,
+        const void *const keys, const void *const values, const size_t n)
+{
+    assert(opts);
+    assert((keys && values) || 0 == n);
+
+    hm_opts_t sized = *opts;
+    const size_t min_cap = calc_min_capacity(n, opts->max_load_factor);
+
+    if (sized.capacity < min_cap) sized.capacity = min_cap;
+
+    hashmap_t *map = hm_create_(&sized);
+    if (!map) return NULL;
+
+    if (parallel_placement(get_hm_header(map), n) && !opts->var_keys
+        && HM_SUCCESS == hm_place_many_parallel_(map, keys, values, n, opts->nthreads))
+    {
+        return map;
+    }
+
+    const hm_status_t status = hm_insert_many(&map, keys, values, n);
+    if (HM_SUCCESS != status && HM_ALREADY_EXISTS != status)
+    {
+        hm_destroy(map);
+        return NULL;
+    }
 
     return map;
 }
@@ -94,13 +211,71 @@ hashmap_t *hm_create_(const hm_opts_t *const opts)
 hashmap_t *hm_clone(const hashmap_t *const map)
 {
     assert(map);
-    return vector_clone(map);
+
+    /* storage of a mapped image isn't a part of the vector */
+    if (get_hm_header(map)->mapping) return hm_rehashed_copy_(map, hm_capacity(map));
+
+    hashmap_t *clone = vector_clone(map);
+    if (!clone) return NULL;
+
+    hm_header_t *header = get_hm_header(clone);
+    header->ctrl = (ctrl_t*)(header + 1);
+    header->slots = vector_get(clone, 0);
+    header->snapshots = NULL;
+
+    if (header->old)
+    {
+        header->old = vector_clone(header->old);
+        if (!header->old)
+        {
+            vector_destroy(clone);
+            return NULL;
+        }
+        hm_header_t *old_header = get_hm_header(header->old);
+        old_header->ctrl = (ctrl_t*)(old_header + 1);
+        old_header->slots = vector_get(header->old, 0);
+        old_header->snapshots = NULL;
+
+        /* arena blocks belong to the source, destroying the clone must never free them */
+        old_header->arena = NULL;
+        old_header->arena_bytes = 0;
+        old_header->garbage = 0;
+    }
+
+    /* clone gets its own copy of the keys */
+    if (header->var_keys
+        && (HM_SUCCESS != arena_rebase(clone) || (header->old && HM_SUCCESS != arena_rebase(header->old))))
+    {
+        hm_destroy(clone);
+        return NULL;
+    }
+
+    return clone;
 }
 
 
 void hm_destroy(hashmap_t *const map)
 {
     assert(map);
+
+    hm_header_t *header = get_hm_header(map);
+
+    /* released along with the last snapshot sharing its chunks */
+    if (header->snapshots)
+    {
+        header->orphaned = true;
+        return;
+    }
+
+    if (header->old)
+    {
+        hm_destroy(header->old);
+    }
+    arena_free(header);
+    if (header->mapping)
+    {
+        header->unmap(header->mapping, header->mapping_size);
+    }
     vector_destroy(map);
 }
 
@@ -122,42 +297,74 @@ hm_status_t hm_insert(hashmap_t **const map, const void *key, const void *value)
 }
 
 
-hm_status_t hm_reserve(hashmap_t **const map, const void *const key, void **const value_out)
+hm_status_t hm_insert_many(hashmap_t **const map,
+        const void *const keys, const void *const values, const size_t n)
 {
     assert(map && *map);
-    assert(key);
-    assert(value_out);
+    assert((keys && values) || 0 == n);
 
-    hm_header_t* header = get_hm_header(*map);
-    const size_t capacity = hm_capacity(*map);
-    const size_t start_index = hash_to_index(header,
-        header->hashfunc(key, header->key_size),
-        capacity);
+    const hm_header_t *header = get_hm_header(*map);
+    const size_t key_size = header->key_size;
+    const size_t value_size = header->value_size;
+    const size_t count = hm_count(*map);
 
-    for (size_t i = 0; i < capacity; ++i)
+    /* single growth for the whole batch instead of repeated doubling,
+       mappings still in the old table count too, otherwise its migration goes on step by step */
+    if (count + header->deleted + n > header->growth_limit)
     {
-        const size_t index = (i + start_index) % capacity;
-        const hm_slot_status_t slot_stat = bitset_test(header->usage_tbl, BIT_FIELD_LEN, index);
-        void *const stored_key = get_key(*map, index);
-        *value_out = get_value(*map, index);
+        const size_t min_cap = calc_min_capacity(count + n, header->max_load_factor);
+        const hm_status_t status = rehash(map, min_cap > header->capacity ? min_cap : header->capacity);
+        if (HM_SUCCESS != status) return status;
+        header = get_hm_header(*map);
+    }
+
+    hash_t hashes[BATCH_SIZE];
+    hm_status_t result = HM_SUCCESS;
+
+    for (size_t done = 0; done < n; done += BATCH_SIZE)
+    {
+        const size_t chunk = n - done < BATCH_SIZE ? n - done : BATCH_SIZE;
+        const char *const chunk_keys = (const char*)keys + done * key_size;
+        const char *const chunk_values = (const char*)values + done * value_size;
 
-        if (HM_SLOT_USED != slot_stat)
+        for (size_t i = 0; i < chunk; ++i)
         {
-            bitset_set(header->usage_tbl, BIT_FIELD_LEN, index, HM_SLOT_USED);
-            set_key(*map, stored_key, key);
-            return HM_SUCCESS;
+            hashes[i] = key_hash(header, chunk_keys + i * key_size);
+            prefetch_home(*map, hashes[i]);
         }
-        else if (0 == memcmp(key, stored_key, header->key_size))
+
+        for (size_t i = 0; i < chunk; ++i)
         {
-            return HM_ALREADY_EXISTS;
+            void *stored_value;
+            const hm_status_t status = reserve_hashed(map, chunk_keys + i * key_size, hashes[i], &stored_value);
+
+            if (HM_SUCCESS == status)
+            {
+                set_value(*map, stored_value, chunk_values + i * value_size);
+            }
+            else if (HM_ALREADY_EXISTS == status)
+            {
+                result = HM_ALREADY_EXISTS;
+            }
+            else return status;
         }
+
+        /* robin hood mode may still grow on probe distance overflow */
+        header = get_hm_header(*map);
     }
 
-    hm_status_t status = rehash(map, 2 * hm_capacity(*map));
-    if (HM_SUCCESS != status) return status;
+    return result;
+}
+
 
-    (void) hm_reserve(map, key, value_out);
-    return HM_SUCCESS;
+hm_status_t hm_reserve(hashmap_t **const map, const void *const key, void **const value_out)
+{
+    assert(map && *map);
+    assert(key);
+    assert(value_out);
+
+    const hm_header_t* header = get_hm_header(*map);
+    return reserve_hashed(map, key, key_hash(header, key), value_out);
 }
 
 
@@ -194,320 +401,1889 @@ void hm_remove(hashmap_t *const map, const void *const key)
     assert(map);
     assert(key);
 
-    hm_header_t* header = get_hm_header(map);
-    const size_t capacity = vector_capacity(map);
-    const size_t start_index = hash_to_index(header,
-        header->hashfunc(key, header->key_size),
-        capacity);
-
-    for (size_t i = 0; i < capacity; ++i)
-    {
-        const size_t index = (i + start_index) % capacity;
-        const hm_slot_status_t slot_stat = bitset_test(header->usage_tbl, BIT_FIELD_LEN, index);
-        switch (slot_stat)
-        {
-            case HM_SLOT_UNUSED:
-                return;
-
-            case HM_SLOT_USED:
-                if (0 == memcmp(key, get_key(map, index), header->key_size))
-                {
-                    bitset_set(header->usage_tbl, BIT_FIELD_LEN, index, HM_SLOT_DELETED);
-                    return;
-                }
-                break;
-
-            case HM_SLOT_DELETED:
-                continue;
-        }
-    }
+    hm_remove_hashed_(map, key, key_hash(get_hm_header(map), key));
 }
 
 
-size_t hm_capacity(const hashmap_t *const map)
+void *hm_get_hashed_(const hashmap_t *const map, const void *const key, const hash_t hash)
 {
     assert(map);
+    assert(key);
 
-    return vector_capacity(map);
+    /* lock-free readers of hm_concurrent come this way, they must not write the header */
+    return find_value(map, key, hash, NULL);
 }
 
 
-size_t hm_count(const hashmap_t *const map)
+hm_status_t hm_reserve_hashed_(hashmap_t **const map, const void *const key, const hash_t hash, void **const value_out)
 {
-    assert(map);
-
-    const size_t capacity = hm_capacity(map);
-    const hm_header_t *header = get_hm_header(map);
-    size_t count = 0;
+    assert(map && *map);
+    assert(key);
+    assert(value_out);
 
-    for (size_t i = 0; i < capacity; ++i)
-    {
-        if (HM_SLOT_USED == bitset_test(header->usage_tbl, BIT_FIELD_LEN, i))
-        {
-            ++count;
-        }
-    }
-    return count;
+    return reserve_hashed(map, key, hash, value_out);
 }
 
 
-void *hm_get(const hashmap_t *const map, const void *const key)
+void hm_remove_hashed_(hashmap_t *const map, const void *const key, const hash_t hash)
 {
     assert(map);
     assert(key);
 
     const hm_header_t* header = get_hm_header(map);
-    const size_t capacity = vector_capacity(map);
-    const size_t start_index = hash_to_index(header,
-        header->hashfunc(key, header->key_size),
-        capacity);
 
-    for (size_t i = 0; i < capacity; ++i)
+    for (hashmap_t *table = map; table; table = get_hm_header(table)->old)
     {
-        const size_t index = (i + start_index) % capacity;
-        const hm_slot_status_t slot_stat = bitset_test(header->usage_tbl, BIT_FIELD_LEN, index);
-
-        switch (slot_stat)
+        const size_t index = find_index(table, key, hash, get_hm_header(map));
+        if (index != hm_capacity(table))
         {
-            case HM_SLOT_UNUSED:
-                return NULL;
-
-            case HM_SLOT_USED:
-                if (0 == memcmp(key, get_key(map, index), header->key_size))
-                {
-                    return get_value(map, index);
-                }
-                break;
-
-            case HM_SLOT_DELETED:
-                continue;
+            hm_erase_at_(map, table, index);
+            return;
         }
     }
 
-    return NULL;
+    if (header->old)
+    {
+        migrate_step(map);
+    }
 }
 
 
-hm_status_t hm_shrink_reserve(hashmap_t **const map, const float reserve)
+hm_status_t hm_insert_absent_(hashmap_t **const map, const void *const key, const hash_t hash, void **const value_out)
 {
     assert(map && *map);
-    assert(reserve >= 0.0f);
+    assert(key);
+    assert(value_out);
 
-    const size_t count = hm_count(*map);
-    const size_t new_cap = count * (1.0f + reserve);
+    if (get_hm_header(*map)->old)
+    {
+        migrate_step(*map);
+    }
 
-    return rehash(map, new_cap);
+    return insert_hashed(map, key, hash, value_out);
 }
 
 
-vector_t *hm_keys(const hashmap_t *const map)
+void hm_erase_at_(hashmap_t *const map, hashmap_t *const table, const size_t index)
 {
     assert(map);
+    assert(table);
 
-    const hm_header_t *header = get_hm_header(map);
-    const size_t capacity = hm_capacity(map);
-
-    vector_t *keys = vector_create(
-        .element_size = header->aligned_key_size,
-        .initial_cap = hm_count(map)
-    );
-
-    if (!keys) return NULL;
+    hm_header_t *table_header = get_hm_header(table);
+    assert(index < hm_capacity(table) && ctrl_is_full(table_header->ctrl[index]));
 
-    for (size_t slot = 0, key = 0; slot < capacity; ++slot)
+    if (table_header->var_keys)
     {
-        if (HM_SLOT_USED == bitset_test(header->usage_tbl, BIT_FIELD_LEN, slot))
-        {
-            vector_set(keys, key++, get_key(map, slot));
-        }
+        table_header->garbage += ((const hm_key_t*)get_key(table, index))->size;
     }
+    erase_index(table, index);
 
-    return keys;
+    if (get_hm_header(map)->old)
+    {
+        migrate_step(map);
+    }
 }
 
 
-vector_t *hm_values(const hashmap_t *const map)
+void hm_touch_value_(const hashmap_t *const map, const void *const value)
 {
     assert(map);
+    assert(value);
 
-    const hm_header_t *header = get_hm_header(map);
-    const size_t capacity = hm_capacity(map);
-
-    vector_t *values = vector_create(
-        .element_size = calc_aligned_size(header->value_size, ALIGNMENT),
-        .initial_cap = hm_count(map));
-
-    if (!values) return NULL;
-
-    for (size_t slot = 0, value = 0; slot < capacity; ++slot)
+    for (const hashmap_t *table = map; table; table = get_hm_header(table)->old)
     {
-        if (HM_SLOT_USED == bitset_test(header->usage_tbl, BIT_FIELD_LEN, slot))
+        const hm_header_t *header = get_hm_header(table);
+        const char *slot = value;
+
+        if (header->snapshots && slot >= header->slots && slot < header->slots + hm_capacity(table) * header->slot_size)
         {
-            vector_set(values, value++, get_value(map, slot));
+            hm_snapshot_preserve_(header, (size_t)(slot - header->slots) / header->slot_size);
+            return;
         }
     }
-
-    return values;
 }
 
 
-int hm_foreach(const hashmap_t *const map,
-        const hm_foreach_t func,
-        void *const param)
+void hm_random_(void *const dst, const size_t size)
 {
-    assert(map);
-    assert(func);
+    assert(dst);
 
-    hm_header_t* header = get_hm_header(map);
-    const size_t capacity = hm_capacity(map);
-    const size_t index = 0;
+#if defined(__linux__)
+    if ((ssize_t)size == getrandom(dst, size, 0)) return;
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+    arc4random_buf(dst, size);
+    return;
+#endif
 
-    for (size_t i = 0; i < capacity; ++i)
+    /* no OS randomness: time, address and a counter mixed by the kernel */
+    static _Atomic uint64_t counter;
+    uint64_t state = (uint64_t)time(NULL) ^ (uint64_t)clock() ^ (uint64_t)(uintptr_t)dst;
+
+    for (size_t i = 0; i < size; i += sizeof(uint64_t))
     {
-        const hm_slot_status_t slot_stat = bitset_test(header->usage_tbl, BIT_FIELD_LEN, index);
+        state = hm_kernel_mix(state ^ HM_KERNEL_P0, atomic_fetch_add(&counter, 1) ^ HM_KERNEL_P1);
+        memcpy((char*)dst + i, &state, (size - i < sizeof(uint64_t)) ? size - i : sizeof(uint64_t));
+    }
+}
 
-        if (HM_SLOT_USED != slot_stat) continue;
 
-        void *const key = get_key(map, index);
-        void *const value = get_value(map, index);
+hashmap_t *hm_rehashed_copy_(const hashmap_t *const map, size_t new_cap)
+{
+    const hm_header_t *old_header = get_hm_header(map);
+    const size_t min_cap = calc_min_capacity(hm_count(map), old_header->max_load_factor);
 
-        int status = func(key, value, param);
-        if (status) return status;
-    }
+    if (new_cap < min_cap) new_cap = min_cap;
 
-    return HM_SUCCESS;
-}
+    hashmap_t *new = create_like(map, new_cap);
 
-int hm_aggregate(const hashmap_t *const map,
-        const hm_aggregate_t func,
-        void *const acc,
-        void *const param)
-{
-    assert(map);
-    assert(func);
-    assert(acc);
+    if (!new) return NULL;
 
-    hm_header_t* header = get_hm_header(map);
-    const size_t capacity = hm_capacity(map);
-    const size_t index = 0;
+    inherit_stats(get_hm_header(new), old_header);
 
-    for (size_t i = 0; i < capacity; ++i)
+    const bool placed = parallel_placement(old_header, hm_count(map)) && !old_header->old
+        && HM_SUCCESS == hm_place_all_parallel_(new, map, old_header->nthreads);
+
+    /* robin hood probe distance overflow: the table is doubled once,
+       when that doesn't help, keys share home slots and get linear probing */
+    for (bool doubled = false; !placed && !place_all(new, map); doubled = true)
     {
-        const hm_slot_status_t slot_stat = bitset_test(header->usage_tbl, BIT_FIELD_LEN, index);
+        hm_destroy(new);
+        if (!doubled) new_cap *= 2;
+        new = create_like(map, new_cap);
 
-        if (HM_SLOT_USED != slot_stat) continue;
+        if (!new) return NULL;
 
-        void *const key = get_key(map, index);
-        void *const value = get_value(map, index);
+        inherit_stats(get_hm_header(new), old_header);
+        if (doubled) get_hm_header(new)->probing = HM_PROBING_LINEAR;
+    }
 
-        int status = func(key, value, acc, param);
-        if (status) return status;
+    /* keys get copied into a single block, bytes of removed keys are dropped */
+    if (get_hm_header(new)->var_keys && HM_SUCCESS != arena_rebase(new))
+    {
+        hm_destroy(new);
+        return NULL;
     }
 
-    return HM_SUCCESS;
+    return new;
 }
 
-int hm_transform(hashmap_t *const map,
-        const hm_transform_t func,
-        void *const param)
+
+hm_status_t hm_insert_var(hashmap_t **const map, const void *const key, const size_t size, const void *const value)
 {
-    assert(map);
-    assert(func);
+    assert(map && *map);
+    assert(get_hm_header(*map)->var_keys);
 
-    return hm_foreach(map, (hm_foreach_t)func, param);
+    return hm_insert(map, &(hm_key_t){key, size}, value);
 }
 
 
-/***                     ***
-* === static functions === *
-***                     ***/
-
-static size_t calc_usage_tbl_size(const size_t capacity)
+hm_status_t hm_reserve_var(hashmap_t **const map, const void *const key, const size_t size, void **const value_out)
 {
-    return calc_aligned_size(capacity * BIT_FIELD_LEN / BYTE, ALIGNMENT);
+    assert(map && *map);
+    assert(get_hm_header(*map)->var_keys);
+
+    return hm_reserve(map, &(hm_key_t){key, size}, value_out);
 }
 
 
-/*
-* Function gives an access to the hash map header that is allocated 
-* after vector's control struct.
-*/
-static hm_header_t *get_hm_header(const hashmap_t *const map)
+hm_status_t hm_upsert_var(hashmap_t **const map, const void *const key, const size_t size, const void *const value)
 {
-    return (hm_header_t*)vector_get_ext_header(map);
+    assert(map && *map);
+    assert(get_hm_header(*map)->var_keys);
+
+    return hm_upsert(map, &(hm_key_t){key, size}, value);
 }
 
-static char *get_key(const hashmap_t *const map, const size_t index)
+
+void *hm_get_var(const hashmap_t *const map, const void *const key, const size_t size)
 {
-    return (char*)vector_get(map, index);
+    assert(map);
+    assert(get_hm_header(map)->var_keys);
+
+    return hm_get(map, &(hm_key_t){key, size});
 }
 
-static char *get_value(const hashmap_t *const map, const size_t index)
+
+void hm_remove_var(hashmap_t *const map, const void *const key, const size_t size)
 {
-    const hm_header_t *header = get_hm_header(map);
-    return get_key(map, index) + header->aligned_key_size;
+    assert(map);
+    assert(get_hm_header(map)->var_keys);
+
+    hm_remove(map, &(hm_key_t){key, size});
 }
 
-static void set_key(hashmap_t *const map, void *const stored_key, const void *const key)
+
+size_t hm_capacity(const hashmap_t *const map)
 {
-    const hm_header_t *header = get_hm_header(map);
-    memcpy(stored_key, key, header->key_size);
+    assert(map);
+
+    return get_hm_header(map)->capacity;
 }
 
-static void set_value(hashmap_t *const map, void *const stored_value, const void *const value)
+
+size_t hm_count(const hashmap_t *const map)
 {
+    assert(map);
+
     const hm_header_t *header = get_hm_header(map);
-    memcpy(stored_value, value, header->value_size);
+    return header->used + (header->old ? hm_count(header->old) : 0);
 }
 
 
-/*
-* `a` and `b` factors used in conversion of the hash code into index.
-* randomization makes hash function less pridictable.
-*/
-static void randomize_factors(hm_header_t *const header)
+size_t hm_tombstones(const hashmap_t *const map)
 {
-    header->a = (rand() % (LARGE_PRIME-1)) + 1;  /* [1, p-1] */
-    header->b = (rand() % (LARGE_PRIME));        /* [0, p-1] */
+    assert(map);
+
+    const hm_header_t *header = get_hm_header(map);
+    return header->deleted + (header->old ? hm_tombstones(header->old) : 0);
 }
 
 
-/*
-* Calculates index utilizing multiplicative hashing. (a*h + b) mod p mod c
-*/
-static size_t hash_to_index(const hm_header_t *header, const hash_t hash, const size_t capacity)
+void *hm_get(const hashmap_t *const map, const void *const key)
 {
-    return ((header->a * hash + header->b) % LARGE_PRIME) % capacity;
+    assert(map);
+    assert(key);
+
+    hm_header_t* header = get_hm_header(map);
+    return find_value(map, key, key_hash(header, key), header);
 }
 
 
-static hm_status_t rehash(hashmap_t **const map, const size_t new_cap)
+size_t hm_get_batch(const hashmap_t *const map, const void *const keys, const size_t n, void **const values_out)
+{
+    assert(map);
+    assert(keys || 0 == n);
+    assert(values_out || 0 == n);
+
+    return lookup_batch(map, keys, n, values_out, NULL);
+}
+
+
+size_t hm_contains_batch(const hashmap_t *const map, const void *const keys, const size_t n, bool *const found_out)
+{
+    assert(map);
+    assert(keys || 0 == n);
+
+    return lookup_batch(map, keys, n, NULL, found_out);
+}
+
+
+hm_probe_t hm_probe(const hashmap_t *const map, const hash_t hash)
+{
+    assert(map);
+
+    hm_header_t *stats = get_hm_header(map);
+    hm_probe_t probe = { .map = map, .hash = hash };
+
+    HM_COUNT(stats, lookups);
+    probe_start(&probe, map, stats);
+    return probe;
+}
+
+
+bool hm_probe_next(hm_probe_t *const probe, const void **const key, void **const value)
+{
+    assert(probe);
+
+    hm_header_t *stats = get_hm_header(probe->map);
+
+    while (probe->table)
+    {
+        const hm_header_t *header = get_hm_header(probe->table);
+        const size_t index = probe_next_index(probe, header, stats);
+
+        if (index != header->capacity)
+        {
+            HM_COUNT(stats, compares);
+            probe->index = index;
+            if (key) *key = get_key(probe->table, index);
+            if (value) *value = get_value(probe->table, index);
+            return true;
+        }
+
+        probe->table = header->old;
+        if (probe->table)
+        {
+            HM_COUNT(stats, lookups);
+            probe_start(probe, probe->table, stats);
+        }
+    }
+
+    return false;
+}
+
+
+void hm_probe_erase(hashmap_t *const map, const hm_probe_t *const probe)
+{
+    assert(map);
+    assert(probe && probe->table);
+    assert(probe->map == map);
+
+    hm_erase_at_(map, (hashmap_t*)probe->table, probe->index);
+}
+
+
+void hm_stats(const hashmap_t *const map, hm_stats_t *const out)
+{
+    assert(map);
+    assert(out);
+
+    const hm_header_t *header = get_hm_header(map);
+    double probe_sum = 0.0;
+
+    *out = (hm_stats_t){
+        .rehashes = header->rehashes,
+        .lookups = header->lookups,
+        .probes = header->probes,
+        .compares = header->compares,
+    };
+
+    for (const hashmap_t *table = map; table; table = get_hm_header(table)->old)
+    {
+        table_stats(table, out, &probe_sum);
+    }
+
+    if (out->used) out->mean_probe = probe_sum / (double)out->used;
+    if (out->clusters) out->mean_cluster = (double)(out->used + out->deleted) / (double)out->clusters;
+}
+
+
+hm_status_t hm_shrink_reserve(hashmap_t **const map, const float reserve)
+{
+    assert(map && *map);
+    assert(reserve >= 0.0f);
+
+    const size_t count = hm_count(*map);
+    const size_t new_cap = count * (1.0f + reserve);
+
+    return rehash(map, new_cap);
+}
+
+
+void hm_compact(hashmap_t *const map)
+{
+    assert(map);
+
+    hm_header_t *header = get_hm_header(map);
+    const size_t capacity = hm_capacity(map);
+
+    if (header->old)
+    {
+        hm_compact(header->old);
+    }
+
+    if (0 == header->deleted) return;
+
+    hm_snapshot_preserve_all_(header);
+
+    /* mark used slots as pending placement, free deleted ones */
+    for (size_t i = 0; i < capacity; ++i)
+    {
+        header->ctrl[i] = ctrl_is_full(header->ctrl[i]) ? HM_CTRL_DELETED : HM_CTRL_EMPTY;
+    }
+    memcpy(header->ctrl + capacity, header->ctrl, HM_GROUP_WIDTH);
+
+    for (size_t i = 0; i < capacity; ++i)
+    {
+        if (HM_CTRL_DELETED != header->ctrl[i]) continue;
+
+        const uint64_t mixed = hm_mix_hash(header, slot_hash(map, i));
+        const ctrl_t h2 = hm_hash_to_fragment(mixed);
+        const size_t home = hm_hash_to_index(header, mixed, capacity);
+        const size_t target = find_free_index(header, mixed, capacity);
+
+        /* slot is already in the right group of its probe sequence */
+        if (probe_group(header, home, i, capacity) == probe_group(header, home, target, capacity))
+        {
+            set_ctrl(header, i, capacity, h2);
+            continue;
+        }
+
+        if (HM_CTRL_EMPTY == header->ctrl[target])
+        {
+            set_ctrl(header, target, capacity, h2);
+            memcpy(get_key(map, target), get_key(map, i), header->slot_size);
+            set_ctrl(header, i, capacity, HM_CTRL_EMPTY);
+        }
+        else
+        {
+            /* target holds another pending slot, swap and place it on the next iteration */
+            set_ctrl(header, target, capacity, h2);
+            swap_slots(map, i, target);
+            --i;
+        }
+    }
+
+    header->deleted = 0;
+}
+
+
+void hm_clear(hashmap_t *const map)
+{
+    assert(map);
+
+    hm_header_t *header = get_hm_header(map);
+    const size_t capacity = hm_capacity(map);
+
+    if (header->old)
+    {
+        hm_destroy(header->old);
+        header->old = NULL;
+        header->migrated = 0;
+    }
+
+    hm_snapshot_preserve_all_(header);
+
+    memset(header->ctrl, HM_CTRL_EMPTY, calc_ctrl_size(capacity));
+    memset(get_dist(header, capacity), 0, calc_dist_size(capacity, header->probing));
+    header->used = 0;
+    header->deleted = 0;
+
+    arena_reset(header);
+}
+
+
+vector_t *hm_keys(const hashmap_t *const map)
+{
+    assert(map);
+
+    const hm_header_t *header = get_hm_header(map);
+
+    vector_t *keys = vector_create(
+        .element_size = header->aligned_key_size,
+        .initial_cap = hm_count(map)
+    );
+
+    if (!keys) return NULL;
+
+    hm_iter_t it = hm_iter(map);
+    const void *key;
+
+    for (size_t i = 0; hm_iter_next(&it, &key, NULL); ++i)
+    {
+        vector_set(keys, i, key);
+    }
+
+    return keys;
+}
+
+
+vector_t *hm_values(const hashmap_t *const map)
+{
+    assert(map);
+
+    const hm_header_t *header = get_hm_header(map);
+
+    vector_t *values = vector_create(
+        .element_size = calc_aligned_size(header->value_size, ALIGNMENT),
+        .initial_cap = hm_count(map));
+
+    if (!values) return NULL;
+
+    hm_iter_t it = hm_iter(map);
+    void *value;
+
+    for (size_t i = 0; hm_iter_next(&it, NULL, &value); ++i)
+    {
+        vector_set(values, i, value);
+    }
+
+    return values;
+}
+
+
+hm_iter_t hm_iter(const hashmap_t *const map)
+{
+    assert(map);
+
+    return (hm_iter_t){ .table = map };
+}
+
+
+bool hm_iter_next(hm_iter_t *const it, const void **const key, void **const value)
+{
+    assert(it);
+
+    while (it->table)
+    {
+        if (it->used)
+        {
+            const size_t index = it->base + __builtin_ctzll(it->used);
+            it->used &= it->used - 1;
+
+            if (key) *key = get_key(it->table, index);
+            if (value) *value = get_value(it->table, index);
+            return true;
+        }
+
+        const hm_header_t *header = get_hm_header(it->table);
+        const size_t capacity = hm_capacity(it->table);
+
+        if (it->next < capacity)
+        {
+            it->base = it->next;
+            it->used = used_slots(header, it->base, capacity);
+            it->next += 64;
+        }
+        else
+        {
+            it->table = header->old;
+            it->next = 0;
+        }
+    }
+
+    return false;
+}
+
+
+size_t hm_iter_entries(hm_iter_t *const it, void *const keys, void *const values, const size_t cap)
+{
+    assert(it);
+    assert(keys || values || 0 == cap);
+
+    if (!it->table) return 0;
+
+    const hm_header_t *header = get_hm_header(it->table);
+    const size_t key_size = header->key_size;
+    const size_t value_size = header->value_size;
+    const void *key;
+    void *value;
+    size_t copied = 0;
+
+    while (copied < cap && hm_iter_next(it, &key, &value))
+    {
+        if (keys) memcpy((char*)keys + copied * key_size, key, key_size);
+        if (values) memcpy((char*)values + copied * value_size, value, value_size);
+        ++copied;
+    }
+
+    return copied;
+}
+
+
+size_t hm_keys_into(const hashmap_t *const map, void *const buf, const size_t cap)
+{
+    assert(map);
+    assert(buf || 0 == cap);
+
+    hm_iter_t it = hm_iter(map);
+    return hm_iter_entries(&it, buf, NULL, cap);
+}
+
+
+size_t hm_values_into(const hashmap_t *const map, void *const buf, const size_t cap)
+{
+    assert(map);
+    assert(buf || 0 == cap);
+
+    hm_iter_t it = hm_iter(map);
+    return hm_iter_entries(&it, NULL, buf, cap);
+}
+
+
+size_t hm_entries_into(const hashmap_t *const map, void *const keys, void *const values, const size_t cap)
+{
+    assert(map);
+
+    hm_iter_t it = hm_iter(map);
+    return hm_iter_entries(&it, keys, values, cap);
+}
+
+
+size_t hm_entries_span(const hashmap_t *const map, hm_span_t *const spans)
+{
+    assert(map);
+    assert(spans);
+
+    size_t count = 0;
+
+    for (const hashmap_t *table = map; table; table = get_hm_header(table)->old)
+    {
+        const hm_header_t *header = get_hm_header(table);
+
+        spans[count++] = (hm_span_t){
+            .slots = header->slots,
+            .ctrl = header->ctrl,
+            .capacity = hm_capacity(table),
+            .stride = header->slot_size,
+            .value_offset = header->aligned_key_size,
+        };
+    }
+
+    return count;
+}
+
+
+int hm_foreach(const hashmap_t *const map,
+        const hm_foreach_t func,
+        void *const param)
+{
+    assert(map);
+    assert(func);
+
+    hm_iter_t it = hm_iter(map);
+    const void *key;
+    void *value;
+
+    while (hm_iter_next(&it, &key, &value))
+    {
+        int status = func(key, value, param);
+        if (status) return status;
+    }
+
+    return HM_SUCCESS;
+}
+
+int hm_aggregate(const hashmap_t *const map,
+        const hm_aggregate_t func,
+        void *const acc,
+        void *const param)
+{
+    assert(map);
+    assert(func);
+    assert(acc);
+
+    hm_iter_t it = hm_iter(map);
+    const void *key;
+    void *value;
+
+    while (hm_iter_next(&it, &key, &value))
+    {
+        int status = func(key, value, acc, param);
+        if (status) return status;
+    }
+
+    return HM_SUCCESS;
+}
+
+int hm_transform(hashmap_t *const map,
+        const hm_transform_t func,
+        void *const param)
+{
+    assert(map);
+    assert(func);
+
+    for (const hashmap_t *table = map; table; table = get_hm_header(table)->old)
+    {
+        hm_snapshot_preserve_all_(get_hm_header(table));
+    }
+
+    hm_iter_t it = hm_iter(map);
+    const void *key;
+    void *value;
+
+    while (hm_iter_next(&it, &key, &value))
+    {
+        int status = func(key, value, param);
+        if (status) return status;
+    }
+
+    return HM_SUCCESS;
+}
+
+
+/***                     ***
+* === static functions === *
+***                     ***/
+
+/*
+* Control bytes are followed by a copy of the first group,
+* so a group can be loaded starting from any slot.
+*/
+static size_t calc_ctrl_size(const size_t capacity)
+{
+    return calc_aligned_size(capacity + HM_GROUP_WIDTH, ALIGNMENT);
+}
+
+
+/*
+* Power of two capacities are rounded up, so indices are reduced by shifting and masking.
+*/
+static size_t calc_capacity(const size_t capacity, const hm_capacity_policy_t policy)
+{
+    if (capacity <= MIN_CAPACITY) return MIN_CAPACITY;
+    if (HM_CAPACITY_EXACT == policy) return capacity;
+
+    return (size_t)1 << (64 - __builtin_clzll(capacity - 1));
+}
+
+
+static size_t calc_growth_limit(const size_t capacity, const float max_load_factor)
+{
+    return (size_t)(capacity * max_load_factor);
+}
+
+
+/*
+* Smallest capacity that holds `count` mappings below the load limit.
+*/
+static size_t calc_min_capacity(const size_t count, const float max_load_factor)
+{
+    return (size_t)(count / max_load_factor) + 1;
+}
+
+
+/*
+* Robin hood probe distances are kept only in that mode.
+*/
+static size_t calc_dist_size(const size_t capacity, const hm_probing_t probing)
+{
+    return (HM_PROBING_ROBIN_HOOD == probing) ? calc_aligned_size(capacity, ALIGNMENT) : 0;
+}
+
+
+/*
+* Key, value and optional hash code, each aligned to `ALIGNMENT`.
+*/
+static size_t calc_slot_size(const hm_opts_t *const opts)
+{
+    const size_t key_size = opts->var_keys ? sizeof(hm_key_t) : opts->key_size;
+    const size_t hash_size = opts->store_hash ? calc_aligned_size(sizeof(hash_t), ALIGNMENT) : 0;
+
+    return calc_aligned_size(key_size, ALIGNMENT) + calc_aligned_size(opts->value_size, ALIGNMENT) + hash_size;
+}
+
+
+/*
+* Fills the header of an empty table, leaves storage pointers and hashing factors to the caller.
+*/
+static void init_header(hm_header_t *const header, const hm_opts_t *const opts, const size_t capacity)
+{
+    const size_t key_size = opts->var_keys ? sizeof(hm_key_t) : opts->key_size;
+    const size_t aligned_key_size = calc_aligned_size(key_size, ALIGNMENT);
+    const size_t aligned_value_size = calc_aligned_size(opts->value_size, ALIGNMENT);
+
+    *header = (hm_header_t){
+        .alloc_opts = opts->alloc_opts,
+        .key_size = key_size,
+        .aligned_key_size = aligned_key_size,
+        .value_size = opts->value_size,
+        .slot_size = calc_slot_size(opts),
+        .hash_offset = opts->store_hash ? aligned_key_size + aligned_value_size : 0,
+        .hashfunc = opts->hashfunc,
+        .seed = opts->seed,
+        .max_load_factor = opts->max_load_factor,
+        .capacity_policy = opts->capacity_policy,
+        .probing = opts->probing,
+        .resize_step = opts->resize_step,
+        .nthreads = opts->nthreads,
+        .pages = opts->pages,
+        .numa = opts->numa,
+        .numa_nodes = opts->numa_nodes,
+        .var_keys = opts->var_keys,
+        .capacity = capacity,
+        .shift = 64 - __builtin_ctzll(capacity),
+        .growth_limit = calc_growth_limit(capacity, opts->max_load_factor),
+    };
+}
+
+
+/*
+* Function gives an access to the hash map header that is allocated 
+* after vector's control struct.
+*/
+static hm_header_t *get_hm_header(const hashmap_t *const map)
+{
+    return (hm_header_t*)vector_get_ext_header(map);
+}
+
+/*
+* Probe distance of each slot from the home index of its key, robin hood mode only.
+*/
+static uint8_t *get_dist(hm_header_t *const header, const size_t capacity)
+{
+    return (uint8_t*)header->ctrl + calc_ctrl_size(capacity);
+}
+
+static char *get_key(const hashmap_t *const map, const size_t index)
+{
+    const hm_header_t *header = get_hm_header(map);
+    return header->slots + index * header->slot_size;
+}
+
+static char *get_value(const hashmap_t *const map, const size_t index)
+{
+    const hm_header_t *header = get_hm_header(map);
+    return get_key(map, index) + header->aligned_key_size;
+}
+
+static void set_key(hashmap_t *const map, void *const stored_key, const void *const key)
+{
+    const hm_header_t *header = get_hm_header(map);
+    memcpy(stored_key, key, header->key_size);
+}
+
+static void set_value(hashmap_t *const map, void *const stored_value, const void *const value)
+{
+    const hm_header_t *header = get_hm_header(map);
+    hm_touch_value_(map, stored_value);
+    memcpy(stored_value, value, header->value_size);
+}
+
+
+/*
+* Copies key bytes into the arena, starting a new block when current one is exhausted.
+*/
+static bool intern_key(hm_header_t *const header, const hm_key_t *const key, hm_key_t *const interned)
+{
+    arena_block_t *block = header->arena;
+
+    if (!block || block->size - block->used < key->size)
+    {
+        const size_t size = key->size > ARENA_BLOCK_SIZE ? key->size : ARENA_BLOCK_SIZE;
+
+        block = malloc(sizeof(arena_block_t) + size);
+        if (!block) return false;
+
+        *block = (arena_block_t){
+            .next = header->arena,
+            .size = size,
+        };
+        header->arena = block;
+    }
+
+    char *data = block->data + block->used;
+    if (key->size) memcpy(data, key->data, key->size);
+
+    block->used += key->size;
+    header->arena_bytes += key->size;
+    *interned = (hm_key_t){data, key->size};
+    return true;
+}
+
+
+/*
+* Moves keys of the map into a fresh arena of exactly fitting single block.
+* Map's arena must not own any of the keys yet.
+*/
+static hm_status_t arena_rebase(hashmap_t *const map)
+{
+    hm_header_t *header = get_hm_header(map);
+    const size_t capacity = hm_capacity(map);
+    size_t bytes = 0;
+
+    for (size_t i = 0; i < capacity; ++i)
+    {
+        if (ctrl_is_full(header->ctrl[i]))
+        {
+            bytes += ((const hm_key_t*)get_key(map, i))->size;
+        }
+    }
+
+    header->arena = NULL;
+    header->arena_bytes = 0;
+    header->garbage = 0;
+
+    if (0 == bytes) return HM_SUCCESS;
+
+    header->arena = malloc(sizeof(arena_block_t) + bytes);
+    if (!header->arena) return (hm_status_t)VECTOR_ALLOC_ERROR;
+
+    *header->arena = (arena_block_t){
+        .size = bytes,
+    };
+
+    for (size_t i = 0; i < capacity; ++i)
+    {
+        if (ctrl_is_full(header->ctrl[i]))
+        {
+            hm_key_t *stored_key = (hm_key_t*)get_key(map, i);
+            (void) intern_key(header, stored_key, stored_key);
+        }
+    }
+
+    return HM_SUCCESS;
+}
+
+
+/*
+* Takes over arena blocks of another table, current block stays the same.
+*/
+static void arena_adopt(hm_header_t *const header, hm_header_t *const from)
+{
+    if (from->arena)
+    {
+        arena_block_t *tail = from->arena;
+        while (tail->next) tail = tail->next;
+
+        if (header->arena)
+        {
+            tail->next = header->arena->next;
+            header->arena->next = from->arena;
+        }
+        else
+        {
+            header->arena = from->arena;
+        }
+    }
+
+    header->arena_bytes += from->arena_bytes;
+    header->garbage += from->garbage;
+
+    from->arena = NULL;
+    from->arena_bytes = 0;
+    from->garbage = 0;
+}
+
+
+static void arena_free(hm_header_t *const header)
+{
+    while (header->arena)
+    {
+        arena_block_t *next = header->arena->next;
+        free(header->arena);
+        header->arena = next;
+    }
+}
+
+
+/*
+* Rewinds the current block for reuse, older blocks are freed.
+*/
+static void arena_reset(hm_header_t *const header)
+{
+    if (header->arena)
+    {
+        arena_block_t *current = header->arena;
+        header->arena = current->next;
+        arena_free(header);
+
+        current->next = NULL;
+        current->used = 0;
+        header->arena = current;
+    }
+
+    header->arena_bytes = 0;
+    header->garbage = 0;
+}
+
+
+/*
+* Bit per slot starting from `base`, set for used slots.
+* Last word of the table is gathered slot by slot.
+*/
+static uint64_t used_slots(const hm_header_t *const header, const size_t base, const size_t capacity)
+{
+    if (base + 64 <= capacity) return ctrl_match_full64(header->ctrl + base);
+
+    uint64_t used = 0;
+    for (size_t i = base; i < capacity; ++i)
+    {
+        used |= (uint64_t)ctrl_is_full(header->ctrl[i]) << (i - base);
+    }
+    return used;
+}
+
+
+/*
+* `a` and `b` factors used in conversion of the hash code into index.
+* randomization makes hash function less pridictable.
+* Kernel seed is drawn along with them once per map, next tables of the map inherit it.
+*/
+static void randomize_factors(hm_header_t *const header)
+{
+    uint64_t random[3];
+    hm_random_(random, (header->hashfunc || header->seed) ? 2 * sizeof(uint64_t) : sizeof(random));
+
+    header->a = random[0] | 1;
+    header->b = random[1];
+    if (!header->hashfunc && !header->seed) header->seed = random[2] | 1;
+}
+
+
+/*
+* Next table of the map continues rehash count and hot path counters.
+*/
+static void inherit_stats(hm_header_t *const header, const hm_header_t *const from)
+{
+    header->rehashes = from->rehashes + 1;
+    header->lookups = from->lookups;
+    header->probes = from->probes;
+    header->compares = from->compares;
+}
+
+
+/*
+* Adds occupancy, probe distances and clusters of the table to `out`.
+* Cluster wrapping around the end of the table is counted as two.
+*/
+static void table_stats(const hashmap_t *const table, hm_stats_t *const out, double *const probe_sum)
+{
+    const hm_header_t *header = get_hm_header(table);
+    const size_t capacity = hm_capacity(table);
+    size_t run = 0;
+
+    out->capacity += capacity;
+    out->bytes += table_bytes(table);
+
+    for (size_t i = 0; i < capacity; ++i)
+    {
+        const ctrl_t ctrl = header->ctrl[i];
+
+        if (HM_CTRL_EMPTY == ctrl)
+        {
+            ++out->empty;
+            run = 0;
+            continue;
+        }
+
+        if (0 == run++) ++out->clusters;
+        if (run > out->max_cluster) out->max_cluster = run;
+
+        if (!ctrl_is_full(ctrl))
+        {
+            ++out->deleted;
+            continue;
+        }
+
+        const size_t home = hm_hash_to_index(header, hm_mix_hash(header, slot_hash(table, i)), capacity);
+        const size_t distance = hm_wrap_index(header, i + capacity - home, capacity);
+
+        ++out->used;
+        ++out->probe_histogram[probe_bucket(distance)];
+        *probe_sum += (double)distance;
+        if (distance > out->max_probe) out->max_probe = distance;
+    }
+}
+
+
+/*
+* Memory held by the table: header with control bytes, slots and key arena blocks.
+*/
+static size_t table_bytes(const hashmap_t *const table)
+{
+    const hm_header_t *header = get_hm_header(table);
+    const size_t capacity = hm_capacity(table);
+    size_t bytes = sizeof(hm_header_t);
+
+    if (header->mapping)
+    {
+        bytes += header->mapping_size;
+    }
+    else
+    {
+        bytes += calc_ctrl_size(capacity) + calc_dist_size(capacity, header->probing) + capacity * header->slot_size;
+    }
+
+    for (const arena_block_t *block = header->arena; block; block = block->next)
+    {
+        bytes += sizeof(arena_block_t) + block->size;
+    }
+
+    return bytes;
+}
+
+
+/*
+* Histogram bucket of the probe distance: 0, 1, 2-3, 4-7, ...
+*/
+static size_t probe_bucket(const size_t distance)
+{
+    if (0 == distance) return 0;
+
+    const size_t bucket = 64 - __builtin_clzll(distance);
+    return (bucket < HM_STATS_BUCKETS) ? bucket : HM_STATS_BUCKETS - 1;
+}
+
+
+/*
+* Hashes key bytes, variable length keys are hashed by their contents.
+*/
+static hash_t key_hash(const hm_header_t *const header, const void *const key)
+{
+    if (header->var_keys)
+    {
+        const hm_key_t *var_key = key;
+        return hm_hash_bytes(header, var_key->data, var_key->size);
+    }
+    return hm_hash_bytes(header, key, header->key_size);
+}
+
+
+/*
+* Sets control byte of the slot, keeping the copy of the first group in sync.
+*/
+static void set_ctrl(hm_header_t *const header, const size_t index, const size_t capacity, const ctrl_t ctrl)
+{
+    hm_touch_slot(header, index);
+    header->ctrl[index] = ctrl;
+    if (index < HM_GROUP_WIDTH)
+    {
+        header->ctrl[capacity + index] = ctrl;
+    }
+}
+
+
+/*
+* Probes groups of slots starting from the key's home index,
+* keys are compared only for slots which hash fragment matches.
+* Returns capacity when the key is missing.
+*/
+static size_t find_index(const hashmap_t *const map, const void *const key, const hash_t hash, hm_header_t *const stats)
+{
+    const hm_header_t *header = get_hm_header(map);
+    HM_COUNT(stats, lookups);
+
+    if (HM_PROBING_ROBIN_HOOD == header->probing)
+    {
+        return rh_find_index(map, key, hash, stats);
+    }
+
+    const size_t capacity = hm_capacity(map);
+    hm_probe_t probe = { .hash = hash };
+    probe_start(&probe, map, stats);
+
+    for (size_t index; capacity != (index = probe_next_index(&probe, header, stats)); )
+    {
+        if (slot_matches(map, index, key, hash, stats)) return index;
+    }
+
+    return capacity;
+}
+
+
+/*
+* Positions the probe at the home group of its hash code in the `table`.
+*/
+static void probe_start(hm_probe_t *const probe, const hashmap_t *const table, hm_header_t *const stats)
+{
+    const hm_header_t *header = get_hm_header(table);
+
+    probe->table = table;
+    probe->mixed = hm_mix_hash(header, probe->hash);
+    probe->pos = hm_hash_to_index(header, probe->mixed, header->capacity);
+    probe->probed = 0;
+    probe_load(probe, header, stats);
+}
+
+
+/*
+* Matches control bytes of the group at `probe->pos` against the hash fragment.
+*/
+static void probe_load(hm_probe_t *const probe, const hm_header_t *const header, hm_header_t *const stats)
+{
+    const hm_group_t group = group_load(header->ctrl + probe->pos);
+    HM_COUNT(stats, probes);
+
+    probe->match = group_match(group, hm_hash_to_fragment(probe->mixed));
+
+    /* key can't be found past the empty slot */
+    probe->last = group_match_empty(group) || probe->probed + HM_GROUP_WIDTH >= header->capacity;
+}
+
+
+/*
+* Linear probing by groups: next slot which hash fragment matches,
+* capacity when the probe sequence of the table ends.
+* Shared by the generic lookup and `hm_probe_next`.
+*/
+static size_t probe_next_index(hm_probe_t *const probe, const hm_header_t *const header, hm_header_t *const stats)
+{
+    const size_t capacity = header->capacity;
+
+    while (!probe->match)
+    {
+        if (probe->last) return capacity;
+
+        probe->probed += HM_GROUP_WIDTH;
+        probe->pos = hm_wrap_index(header, probe->pos + HM_GROUP_WIDTH, capacity);
+        probe_load(probe, header, stats);
+    }
+
+    const size_t index = hm_wrap_index(header, probe->pos + mask_lowest(probe->match), capacity);
+    probe->match = mask_clear_lowest(probe->match);
+    return index;
+}
+
+
+/*
+* Value of the key in the map or in the table being migrated, NULL if missing.
+* Counters go into `stats`, the header of the map itself (the old table's one is short lived).
+*/
+static void *find_value(const hashmap_t *const map, const void *const key, const hash_t hash, hm_header_t *const stats)
+{
+    const hm_header_t *header = get_hm_header(map);
+    const size_t index = find_index(map, key, hash, stats);
+
+    if (index != hm_capacity(map)) return get_value(map, index);
+
+    return header->old ? find_value(header->old, key, hash, stats) : NULL;
+}
+
+
+/*
+* Requests cache lines that probing for the hash will touch first.
+*/
+static void prefetch_home(const hashmap_t *const map, const hash_t hash)
+{
+    hm_header_t *header = get_hm_header(map);
+    const size_t capacity = hm_capacity(map);
+    const size_t index = hm_hash_to_index(header, hm_mix_hash(header, hash), capacity);
+
+    __builtin_prefetch(header->ctrl + index);
+    __builtin_prefetch(get_key(map, index));
+    if (HM_PROBING_ROBIN_HOOD == header->probing)
+    {
+        __builtin_prefetch(get_dist(header, capacity) + index);
+    }
+}
+
+
+/*
+* Looks keys up by chunks of `BATCH_SIZE`:
+* hashes the whole chunk and prefetches home slots, then probes.
+*/
+static size_t lookup_batch(const hashmap_t *const map, const char *keys, const size_t n,
+        void **const values_out, bool *const found_out)
+{
+    hm_header_t *header = get_hm_header(map);
+    hash_t hashes[BATCH_SIZE];
+    size_t found = 0;
+
+    for (size_t done = 0; done < n; done += BATCH_SIZE)
+    {
+        const size_t chunk = n - done < BATCH_SIZE ? n - done : BATCH_SIZE;
+        const char *const chunk_keys = keys + done * header->key_size;
+
+        for (size_t i = 0; i < chunk; ++i)
+        {
+            hashes[i] = key_hash(header, chunk_keys + i * header->key_size);
+            prefetch_home(map, hashes[i]);
+        }
+
+        for (size_t i = 0; i < chunk; ++i)
+        {
+            void *value = find_value(map, chunk_keys + i * header->key_size, hashes[i], header);
+            found += (NULL != value);
+            if (values_out) values_out[done + i] = value;
+            if (found_out) found_out[done + i] = (NULL != value);
+        }
+    }
+
+    return found;
+}
+
+
+/*
+* Compares key stored in the slot, cached hash codes reject mismatches early.
+*/
+static bool slot_matches(const hashmap_t *const map, const size_t index, const void *const key, const hash_t hash,
+        hm_header_t *const stats)
+{
+    const hm_header_t *header = get_hm_header(map);
+    const char *stored_key = get_key(map, index);
+
+    if (header->hash_offset && *(const hash_t*)(stored_key + header->hash_offset) != hash)
+    {
+        return false;
+    }
+
+    HM_COUNT(stats, compares);
+    if (header->var_keys)
+    {
+        const hm_key_t *a = key;
+        const hm_key_t *b = (const hm_key_t*)stored_key;
+        return a->size == b->size && (0 == a->size || 0 == memcmp(a->data, b->data, a->size));
+    }
+    return 0 == memcmp(key, stored_key, header->key_size);
+}
+
+
+/*
+* Hash code of the key stored in the slot, cached one when available.
+*/
+static hash_t slot_hash(const hashmap_t *const map, const size_t index)
+{
+    const hm_header_t *header = get_hm_header(map);
+    const char *stored_key = get_key(map, index);
+
+    if (header->hash_offset)
+    {
+        return *(const hash_t*)(stored_key + header->hash_offset);
+    }
+    return key_hash(header, stored_key);
+}
+
+
+/*
+* Places mapping known to be missing from the map by copying the whole slot,
+* no keys are compared and the map doesn't grow.
+* Returns capacity when there is no room for it.
+*/
+static size_t place_slot(hashmap_t *const map, const char *const slot, const hash_t hash)
+{
+    hm_header_t *header = get_hm_header(map);
+    const size_t capacity = hm_capacity(map);
+    const uint64_t mixed = hm_mix_hash(header, hash);
+
+    const size_t index = (HM_PROBING_ROBIN_HOOD == header->probing)
+        ? rh_make_room(map, mixed)
+        : find_free_index(header, mixed, capacity);
+
+    if (index == capacity) return capacity;
+
+    claim_slot(header, index, capacity, mixed);
+    memcpy(get_key(map, index), slot, header->slot_size);
+    return index;
+}
+
+
+/*
+* Places all mappings of `src` (including its old table) into `dst`.
+* Returns false when `dst` runs out of room.
+*/
+static bool place_all(hashmap_t *const dst, const hashmap_t *const src)
+{
+    const size_t dst_capacity = hm_capacity(dst);
+
+    for (const hashmap_t *table = src; table; table = get_hm_header(table)->old)
+    {
+        const hm_header_t *table_header = get_hm_header(table);
+        const size_t capacity = hm_capacity(table);
+
+        for (size_t i = 0; i < capacity; ++i)
+        {
+            if (ctrl_is_full(table_header->ctrl[i])
+                && dst_capacity == place_slot(dst, get_key(table, i), slot_hash(table, i)))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+/*
+* Returns first empty or deleted slot in the probe sequence or capacity when map is full.
+*/
+static size_t find_free_index(const hm_header_t *const header, const uint64_t mixed, const size_t capacity)
+{
+    size_t pos = hm_hash_to_index(header, mixed, capacity);
+
+    for (size_t probed = 0; probed < capacity; probed += HM_GROUP_WIDTH)
+    {
+        const hm_mask_t free = group_match_empty_or_deleted(group_load(header->ctrl + pos));
+        if (free)
+        {
+            return hm_wrap_index(header, pos + mask_lowest(free), capacity);
+        }
+        pos = hm_wrap_index(header, pos + HM_GROUP_WIDTH, capacity);
+    }
+
+    return capacity;
+}
+
+
+/*
+* Releases used slot. Slot becomes empty when no probe sequence could
+* have passed over it: every group containing the slot has an empty one.
+* Otherwise it is marked as deleted.
+*/
+static void erase_index(hashmap_t *const map, const size_t index)
 {
-    assert(new_cap >= hm_count(*map));
+    hm_header_t *header = get_hm_header(map);
+    const size_t capacity = hm_capacity(map);
 
-    const hm_header_t *old_header = get_hm_header(*map);
-    const size_t prev_capacity = hm_capacity(*map);
+    if (HM_PROBING_ROBIN_HOOD == header->probing)
+    {
+        rh_erase_index(map, index);
+        return;
+    }
 
-    hashmap_t *new = hm_create(
-        .capacity = new_cap,
-        .key_size = old_header->key_size,
-        .value_size = old_header->value_size,
-        .hashfunc = old_header->hashfunc,
-        .alloc_opts = old_header->alloc_opts,
-    );
+    const size_t before = hm_wrap_index(header, index + capacity - HM_GROUP_WIDTH, capacity);
 
-    if (!new) return (hm_status_t)VECTOR_ALLOC_ERROR;
+    const hm_mask_t empty_before = group_match_empty(group_load(header->ctrl + before));
+    const hm_mask_t empty_after = group_match_empty(group_load(header->ctrl + index));
+    const bool was_never_full = empty_before && empty_after
+        && mask_leading_zeros(empty_before) + mask_trailing_zeros(empty_after) < HM_GROUP_WIDTH;
+
+    --header->used;
+    if (was_never_full)
+    {
+        set_ctrl(header, index, capacity, HM_CTRL_EMPTY);
+    }
+    else
+    {
+        set_ctrl(header, index, capacity, HM_CTRL_DELETED);
+        ++header->deleted;
+    }
+}
+
+
+/*
+* `hm_reserve` for the key which hash code is already calculated.
+*/
+static hm_status_t reserve_hashed(hashmap_t **const map, const void *const key, const hash_t hash, void **const value_out)
+{
+    const hm_header_t* header = get_hm_header(*map);
+
+    if (header->old)
+    {
+        migrate_step(*map);
+    }
+
+    const size_t index = find_index(*map, key, hash, get_hm_header(*map));
+    if (index != hm_capacity(*map))
+    {
+        hm_touch_slot(header, index);
+        *value_out = get_value(*map, index);
+        return HM_ALREADY_EXISTS;
+    }
+
+    /* mapping stays in the old table until it gets migrated */
+    void *old_value = header->old ? find_value(header->old, key, hash, get_hm_header(*map)) : NULL;
+    if (old_value)
+    {
+        hm_touch_value_(header->old, old_value);
+        *value_out = old_value;
+        return HM_ALREADY_EXISTS;
+    }
+
+    return insert_hashed(map, key, hash, value_out);
+}
+
+
+/*
+* Places the key missing in the map, grows the map when there is no room.
+*/
+static hm_status_t insert_hashed(hashmap_t **const map, const void *const key, const hash_t hash, void **const value_out)
+{
+    hm_header_t* header = get_hm_header(*map);
+    const size_t capacity = hm_capacity(*map);
+    const uint64_t mixed = hm_mix_hash(header, hash);
+    size_t index;
+
+    /* reclaim arena space when removed keys take most of it */
+    if (header->garbage > ARENA_BLOCK_SIZE && 2 * header->garbage > header->arena_bytes)
+    {
+        const hm_status_t status = rehash(map, capacity);
+        if (HM_SUCCESS != status) return status;
+
+        return insert_hashed(map, key, hash, value_out);
+    }
+
+    /* key bytes are copied before robin hood shifts any slot, nothing to undo on failure */
+    hm_key_t interned;
+    if (header->var_keys && !intern_key(header, key, &interned))
+    {
+        return (hm_status_t)VECTOR_ALLOC_ERROR;
+    }
+
+    const bool over_limit = header->used + header->deleted >= header->growth_limit;
+    bool grow;
+
+    if (HM_PROBING_ROBIN_HOOD == header->probing)
+    {
+        index = over_limit ? capacity : rh_make_room(*map, mixed);
+
+        /* distance overflow in a sparse table won't go away by growing,
+           robin hood layout is valid for linear probing, so the table switches to it */
+        if (index == capacity && !over_limit && 2 * header->used < header->growth_limit)
+        {
+            header->probing = HM_PROBING_LINEAR;
+            index = find_free_index(header, mixed, capacity);
+        }
+        grow = (index == capacity);
+    }
+    else
+    {
+        index = find_free_index(header, mixed, capacity);
+        grow = (index == capacity) || (HM_CTRL_EMPTY == header->ctrl[index] && over_limit);
+    }
+
+    if (grow)
+    {
+        hm_status_t status = HM_SUCCESS;
+
+        if (header->var_keys)
+        {
+            header->garbage += interned.size;
+        }
+
+        if (header->old)
+        {
+            status = finish_migration(map);
+        }
+        /* when tombstones hold most of the load, purging them in place is enough */
+        else if (header->deleted && 2 * header->used < header->growth_limit)
+        {
+            hm_compact(*map);
+        }
+        else if (header->resize_step)
+        {
+            status = start_migration(map);
+        }
+        else
+        {
+            status = rehash(map, 2 * capacity);
+        }
+
+        if (HM_SUCCESS != status) return status;
+
+        return insert_hashed(map, key, hash, value_out);
+    }
+
+    claim_slot(header, index, capacity, mixed);
+    set_key(*map, get_key(*map, index), header->var_keys ? &interned : key);
+    if (header->hash_offset)
+    {
+        *(hash_t*)(get_key(*map, index) + header->hash_offset) = hash;
+    }
+    *value_out = get_value(*map, index);
+    return HM_SUCCESS;
+}
+
+
+/*
+* Takes free slot for the key with given mixed hash.
+*/
+static void claim_slot(hm_header_t *const header, const size_t index, const size_t capacity, const uint64_t mixed)
+{
+    if (HM_CTRL_DELETED == header->ctrl[index])
+    {
+        --header->deleted;
+    }
+    ++header->used;
+
+    set_ctrl(header, index, capacity, hm_hash_to_fragment(mixed));
+}
+
+
+/*
+* Robin hood lookup, stops as soon as resident slot is closer
+* to its home than the key would be.
+*/
+static size_t rh_find_index(const hashmap_t *const map, const void *const key, const hash_t hash, hm_header_t *const stats)
+{
+    hm_header_t *header = get_hm_header(map);
+    const size_t capacity = hm_capacity(map);
+    const uint64_t mixed = hm_mix_hash(header, hash);
+    const uint8_t *dist = get_dist(header, capacity);
+    const ctrl_t h2 = hm_hash_to_fragment(mixed);
+    size_t index = hm_hash_to_index(header, mixed, capacity);
 
-    for (size_t i = 0; i < prev_capacity; ++i)
+    for (uint8_t d = 0; d < UINT8_MAX; ++d)
     {
-        if (HM_SLOT_USED == bitset_test(old_header->usage_tbl, BIT_FIELD_LEN, i))
+        const ctrl_t ctrl = header->ctrl[index];
+        HM_COUNT(stats, probes);
+
+        if (HM_CTRL_EMPTY == ctrl || dist[index] < d) break;
+
+        if (h2 == ctrl && slot_matches(map, index, key, hash, stats))
         {
-            (void) hm_insert(&new, get_key(*map, i), get_value(*map, i)); /* always succeedes */
+            return index;
         }
+        index = hm_wrap_index(header, index + 1, capacity);
+    }
+
+    return capacity;
+}
+
+
+/*
+* Robin hood placement: new key takes the first slot which resident is
+* closer to its home, the rest of the run is shifted one slot forward.
+* Returns vacated slot or capacity when probe distance would overflow.
+*/
+static size_t rh_make_room(hashmap_t *const map, const uint64_t mixed)
+{
+    hm_header_t *header = get_hm_header(map);
+    const size_t capacity = hm_capacity(map);
+    uint8_t *dist = get_dist(header, capacity);
+    size_t index = hm_hash_to_index(header, mixed, capacity);
+    uint8_t d = 0;
+
+    while (HM_CTRL_EMPTY != header->ctrl[index] && dist[index] >= d)
+    {
+        if (UINT8_MAX == ++d) return capacity;
+        index = hm_wrap_index(header, index + 1, capacity);
+    }
+
+    size_t last = index;
+    while (HM_CTRL_EMPTY != header->ctrl[last])
+    {
+        if (UINT8_MAX == dist[last] + 1) return capacity;
+        last = hm_wrap_index(header, last + 1, capacity);
+    }
+
+    while (last != index)
+    {
+        const size_t prev = hm_wrap_index(header, last + capacity - 1, capacity);
+        move_slot(map, last, prev);
+        dist[last] = dist[prev] + 1;
+        last = prev;
+    }
+
+    dist[index] = d;
+    return index;
+}
+
+
+/*
+* Backward shift deletion: following slots displaced from their home
+* move one slot back, so no tombstones are left.
+*/
+static void rh_erase_index(hashmap_t *const map, size_t index)
+{
+    hm_header_t *header = get_hm_header(map);
+    const size_t capacity = hm_capacity(map);
+    uint8_t *dist = get_dist(header, capacity);
+    size_t next = hm_wrap_index(header, index + 1, capacity);
+
+    for (size_t shifted = 0; shifted < capacity
+            && ctrl_is_full(header->ctrl[next]) && dist[next] > 0; ++shifted)
+    {
+        move_slot(map, index, next);
+        dist[index] = dist[next] - 1;
+        index = next;
+        next = hm_wrap_index(header, next + 1, capacity);
+    }
+
+    set_ctrl(header, index, capacity, HM_CTRL_EMPTY);
+    dist[index] = 0;
+    --header->used;
+}
+
+
+/*
+* Moves slot contents and its control byte.
+*/
+static void move_slot(hashmap_t *const map, const size_t to, const size_t from)
+{
+    hm_header_t *header = get_hm_header(map);
+    hm_touch_slot(header, to);
+    memcpy(get_key(map, to), get_key(map, from), header->slot_size);
+    set_ctrl(header, to, hm_capacity(map), header->ctrl[from]);
+}
+
+
+/*
+* Exchanges contents of two slots through a small stack buffer.
+*/
+static void swap_slots(hashmap_t *const map, const size_t a, const size_t b)
+{
+    const hm_header_t *header = get_hm_header(map);
+    char *slot_a = get_key(map, a);
+    char *slot_b = get_key(map, b);
+    char tmp[64];
+
+    hm_touch_slot(header, a);
+    hm_touch_slot(header, b);
+
+    for (size_t offset = 0; offset < header->slot_size; offset += sizeof(tmp))
+    {
+        const size_t len = (header->slot_size - offset < sizeof(tmp))
+            ? header->slot_size - offset
+            : sizeof(tmp);
+
+        memcpy(tmp, slot_a + offset, len);
+        memcpy(slot_a + offset, slot_b + offset, len);
+        memcpy(slot_b + offset, tmp, len);
+    }
+}
+
+
+/*
+* Number of the group in the probe sequence started at `home` that contains `index`.
+*/
+static size_t probe_group(const hm_header_t *header, const size_t home, const size_t index, const size_t capacity)
+{
+    return hm_wrap_index(header, index + capacity - home, capacity) / HM_GROUP_WIDTH;
+}
+
+
+/*
+* Table in its own mapping with page and memory policies applied,
+* NULL when the table is too small for them or pages can't be mapped.
+*/
+static hashmap_t *create_paged(const hm_opts_t *const opts, const size_t capacity)
+{
+    const size_t ctrl_area = calc_aligned_size(calc_ctrl_size(capacity) + calc_dist_size(capacity, opts->probing), 64);
+    const size_t slots_size = capacity * calc_slot_size(opts);
+    size_t size = ctrl_area + slots_size;
+
+    if (size < PAGED_MIN_SIZE) return NULL;
+
+    char *mapping = hm_pages_map_(opts, &size);
+    if (!mapping) return NULL;
+
+    hashmap_t *map = hm_create_mapped_(opts, capacity, (ctrl_t*)mapping, mapping + ctrl_area);
+    if (!map)
+    {
+        hm_pages_unmap_(mapping, size);
+        return NULL;
+    }
+
+    hm_header_t *header = get_hm_header(map);
+    header->mapping = mapping;
+    header->mapping_size = size;
+    header->unmap = hm_pages_unmap_;
+
+    /* fresh pages read as zeros, with several threads slots are touched first by them as well */
+    hm_pages_fill_(header->ctrl, HM_CTRL_EMPTY, calc_ctrl_size(capacity), opts->nthreads);
+    if (opts->nthreads > 1)
+    {
+        hm_pages_fill_(header->slots, 0, slots_size, opts->nthreads);
     }
+    randomize_factors(header);
+
+    return map;
+}
+
+
+/*
+* Creates empty map with the same options and given capacity.
+*/
+static hashmap_t *create_like(const hashmap_t *const map, const size_t capacity)
+{
+    const hm_header_t *header = get_hm_header(map);
+
+    return hm_create(
+        .capacity = capacity,
+        .key_size = header->key_size,
+        .value_size = header->value_size,
+        .hashfunc = header->hashfunc,
+        .seed = header->seed,
+        .max_load_factor = header->max_load_factor,
+        .capacity_policy = header->capacity_policy,
+        .probing = header->probing,
+        .store_hash = header->hash_offset != 0,
+        .resize_step = header->resize_step,
+        .nthreads = header->nthreads,
+        .pages = header->pages,
+        .numa = header->numa,
+        .numa_nodes = header->numa_nodes,
+        .var_keys = header->var_keys,
+        .alloc_opts = header->alloc_opts,
+    );
+}
+
+
+/*
+* Moves all mappings into a new map, including ones
+* waiting for incremental migration.
+*/
+static hm_status_t rehash(hashmap_t **const map, const size_t new_cap)
+{
+    hashmap_t *new = hm_rehashed_copy_(*map, new_cap);
+
+    if (!new) return (hm_status_t)VECTOR_ALLOC_ERROR;
 
     hm_destroy(*map);
     *map = new;
     return HM_SUCCESS;
 }
 
+
+/*
+* Placing mappings is split among threads for large linear probing maps only,
+* for small ones starting threads costs more than it saves.
+*/
+static bool parallel_placement(const hm_header_t *const header, const size_t count)
+{
+    return header->nthreads > 1
+        && HM_PROBING_LINEAR == header->probing
+        && count >= PARALLEL_MIN_COUNT;
+}
+
+
+/*
+* Incremental resize: doubled table takes over the map,
+* while current one is kept for lookups and migrated step by step.
+*/
+static hm_status_t start_migration(hashmap_t **const map)
+{
+    hashmap_t *new = create_like(*map, 2 * hm_capacity(*map));
+
+    if (!new) return (hm_status_t)VECTOR_ALLOC_ERROR;
+
+    hm_header_t *header = get_hm_header(new);
+    inherit_stats(header, get_hm_header(*map));
+    header->old = *map;
+    header->migrated = 0;
+
+    *map = new;
+    return HM_SUCCESS;
+}
+
+
+/*
+* Migrates up to `resize_step` slots of the old table,
+* the old table is released once it gets empty.
+*/
+static void migrate_step(hashmap_t *const map)
+{
+    hm_header_t *header = get_hm_header(map);
+    const hm_header_t *old_header = get_hm_header(header->old);
+    const size_t old_capacity = hm_capacity(header->old);
+
+    for (size_t step = 0; step < header->resize_step && old_header->used; ++step)
+    {
+        if (header->migrated == old_capacity) header->migrated = 0;
+
+        const size_t index = header->migrated;
+        if (ctrl_is_full(old_header->ctrl[index]) && !migrate_slot(map, index)) break;
+
+        /* robin hood removal may shift next mapping into the same slot */
+        if (!ctrl_is_full(old_header->ctrl[index])) ++header->migrated;
+    }
+
+    if (0 == old_header->used)
+    {
+        /* migrated keys still point into the old arena */
+        arena_adopt(header, get_hm_header(header->old));
+        hm_destroy(header->old);
+        header->old = NULL;
+    }
+}
+
+
+/*
+* Moves mapping from the old table slot without growing the map.
+* Returns false when there is no room for it.
+*/
+static bool migrate_slot(hashmap_t *const map, const size_t index)
+{
+    hm_header_t *header = get_hm_header(map);
+
+    if (header->used + header->deleted >= header->growth_limit) return false;
+
+    const hash_t hash = slot_hash(header->old, index);
+    if (hm_capacity(map) == place_slot(map, get_key(header->old, index), hash)) return false;
+
+    erase_index(header->old, index);
+    return true;
+}
+
+
+/*
+* Completes pending migration at once, when mappings don't fit
+* under the load limit the map gets rehashed.
+*/
+static hm_status_t finish_migration(hashmap_t **const map)
+{
+    hm_header_t *header = get_hm_header(*map);
+    const size_t old_count = hm_count(header->old);
+
+    if (header->used + header->deleted + old_count >= header->growth_limit)
+    {
+        return rehash(map, 2 * hm_capacity(*map));
+    }
+
+    const size_t resize_step = header->resize_step;
+
+    header->resize_step = SIZE_MAX;
+    migrate_step(*map);
+    header->resize_step = resize_step;
+
+    /* robin hood probe distance overflow */
+    if (header->old)
+    {
+        return rehash(map, 2 * hm_capacity(*map));
+    }
+
+    return HM_SUCCESS;
+}
+
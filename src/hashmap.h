@@ -3,15 +3,73 @@
 
 #include "hash.h"
 #include "vector.h"
+#include <stdint.h>
 
 typedef vector_t hashmap_t;
 
+#define HM_DEFAULT_MAX_LOAD_FACTOR 0.75f
+
+typedef enum hm_capacity_policy
+{
+    HM_CAPACITY_POW2 = 0, /**< capacity is rounded up to a power of two */
+    HM_CAPACITY_EXACT     /**< capacity is kept as requested */
+}
+hm_capacity_policy_t;
+
+typedef enum hm_probing
+{
+    HM_PROBING_LINEAR = 0,  /**< linear probing by groups of slots, removal leaves tombstones */
+    HM_PROBING_ROBIN_HOOD   /**< robin hood insertion with backward shift deletion, no tombstones */
+}
+hm_probing_t;
+
+typedef enum hm_pages
+{
+    HM_PAGES_DEFAULT = 0,  /**< table is allocated through the vector */
+    HM_PAGES_TRANSPARENT,  /**< large tables are mapped separately and advised for transparent huge pages */
+    HM_PAGES_HUGETLB       /**< explicit huge pages, transparent ones when none are reserved */
+}
+hm_pages_t;
+
+typedef enum hm_numa
+{
+    HM_NUMA_DEFAULT = 0,   /**< pages land on the node of the thread touching them first */
+    HM_NUMA_INTERLEAVE,    /**< pages are spread round-robin over `numa_nodes` */
+    HM_NUMA_BIND           /**< pages are taken from `numa_nodes` only */
+}
+hm_numa_t;
+
+/*
+* Key of variable length, used in place of fixed size keys when `var_keys` is set.
+*/
+typedef struct hm_key
+{
+    const void *data;
+    size_t size;
+}
+hm_key_t;
+
 typedef struct hm_opts
 {
     size_t key_size;
     size_t value_size;
     size_t capacity;
-    hashfunc_t hashfunc;
+    hashfunc_t hashfunc;     /**< NULL - built-in seeded kernels, @see hm_kernels.h */
+    uint64_t seed;           /**< seed of the built-in kernels, 0 - random per map */
+    float max_load_factor;   /**< share of used and deleted slots that triggers growth, (0, 1] */
+    hm_capacity_policy_t capacity_policy;
+    hm_probing_t probing;
+    bool store_hash;         /**< cache hash code in each slot: no hashing on rehash,
+                                  mismatching keys are rejected without comparison */
+    size_t resize_step;      /**< old slots migrated per operation while growing incrementally,
+                                  0 - rehash at once */
+    bool var_keys;           /**< keys are `hm_key_t` of variable length (`key_size` is ignored),
+                                  key bytes are copied into the map's arena */
+    size_t nthreads;         /**< threads placing mappings when large maps are rehashed or built
+                                  (linear probing only), 0 or 1 - single threaded */
+    hm_pages_t pages;        /**< page policy of tables larger than a huge page */
+    hm_numa_t numa;          /**< memory policy of tables larger than a huge page (Linux) */
+    unsigned long numa_nodes; /**< node mask for `numa`, 0 - all nodes */
     alloc_opts_t alloc_opts; /**< @see vector_opts_t::alloc_opts_t    */
 }
 hm_opts_t;
@@ -19,11 +77,97 @@ hm_opts_t;
 typedef enum hm_status_t
 {
     HM_SUCCESS = VECTOR_SUCCESS,
-    HM_ALREADY_EXISTS = VECTOR_STATUS_LAST
+    HM_ALREADY_EXISTS = VECTOR_STATUS_LAST,
+    HM_IO_ERROR,        /**< image file couldn't be written, @see hm_save */
+    HM_UNKNOWN_HASHFUNC, /**< hashfunc has no registered id, @see hm_register_hashfunc */
+    HM_UNSUPPORTED      /**< map with variable length keys can't be saved, @see hm_save */
 }
 hm_status_t;
 
 
+#define HM_STATS_BUCKETS 16
+
+/*
+* Table health report, see `hm_stats`. Probe distance of a mapping is the number of slots
+* between its home slot and the slot it is stored in.
+*/
+typedef struct hm_stats
+{
+    size_t capacity;
+    size_t used;
+    size_t deleted;
+    size_t empty;
+
+    double mean_probe;
+    size_t max_probe;
+    size_t probe_histogram[HM_STATS_BUCKETS]; /**< bucket 0 - distance 0, bucket i - [2^(i-1), 2^i),
+                                                   the last one takes all longer distances */
+    size_t clusters;     /**< runs of consecutive used or deleted slots */
+    double mean_cluster;
+    size_t max_cluster;
+
+    size_t rehashes;     /**< tables the map moved through, incremental resizes included */
+    size_t bytes;        /**< tables and key arena */
+
+    /* hot path counters, zero unless the library is configured with --enable-stats-counters */
+    uint64_t lookups;    /**< probe sequences started */
+    uint64_t probes;     /**< groups loaded, slots visited with robin hood probing */
+    uint64_t compares;   /**< keys compared */
+}
+hm_stats_t;
+
+
+/*
+* Cursor over mappings of the map, see `hm_iter_next`.
+* Fields are private.
+*/
+typedef struct hm_iter
+{
+    const hashmap_t *table; /* table being scanned, the map or its old table */
+    size_t next;            /* first slot of the next word of slots to scan */
+    size_t base;            /* first slot of the current word */
+    uint64_t used;          /* used slots of the current word left to visit */
+}
+hm_iter_t;
+
+
+/*
+* Cursor over stored keys which hash fragment matches the hash code, see `hm_probe_next`.
+* Fields are private.
+*/
+typedef struct hm_probe
+{
+    const hashmap_t *map;
+    const hashmap_t *table; /* table being probed, the map or its old table, NULL - done */
+    hash_t hash;
+    uint64_t mixed;         /* hash code mixed by the table's factors */
+    uint64_t match;         /* matching slots of the current group left to visit */
+    size_t pos;             /* first slot of the current group */
+    size_t probed;          /* slots probed before the current group */
+    size_t index;           /* slot of the last candidate */
+    bool last;              /* current group ends the probe sequence of the table */
+}
+hm_probe_t;
+
+
+/*
+* Non-owning view of a table's slot array, see `hm_entries_span`.
+* Slot `i` is used when `ctrl[i] >= 0`, its key is at `slots + i * stride`
+* and value at `slots + i * stride + value_offset`.
+*/
+typedef struct hm_span
+{
+    char *slots;
+    const int8_t *ctrl;
+    size_t capacity;
+    size_t stride;
+    size_t value_offset;
+}
+hm_span_t;
+
+#define HM_MAX_SPANS 2 /**< the map and its old table under incremental resize */
+
+
 typedef int (*hm_foreach_t) (const void *const key, const void *const value, void *const param);
 typedef int (*hm_transform_t) (const void *const key, void *const value, void *const param);
 typedef int (*hm_aggregate_t) (const void *const key, const void *const value, void *const acc, void *const param);
@@ -35,6 +179,7 @@ typedef int (*hm_aggregate_t) (const void *const key, const void *const value, v
 #define hm_create(...) \
     hm_create_(&(hm_opts_t){ \
         .capacity = 256, \
+        .max_load_factor = HM_DEFAULT_MAX_LOAD_FACTOR, \
         __VA_ARGS__ \
     })
 
@@ -44,6 +189,24 @@ typedef int (*hm_aggregate_t) (const void *const key, const void *const value, v
 hashmap_t *hm_create_(const hm_opts_t *const opts);
 
 
+/*
+* The wrapper for `hm_build_from_` function that provides default values.
+*/
+#define hm_build_from(keys, values, n, ...) \
+    hm_build_from_(&(hm_opts_t){ \
+        .capacity = 256, \
+        .max_load_factor = HM_DEFAULT_MAX_LOAD_FACTOR, \
+        __VA_ARGS__ \
+    }, keys, values, n)
+
+/*
+* Creates hashmap sized for `n` mappings and fills it from packed arrays of keys and values.
+* Duplicate keys keep the first value. Returns NULL on allocation failure.
+*/
+hashmap_t *hm_build_from_(const hm_opts_t *const opts,
+        const void *const keys, const void *const values, const size_t n);
+
+
 /*
 * Release hashmap resources.
 */
@@ -63,9 +226,21 @@ hashmap_t *hm_clone(const hashmap_t *const map);
 hm_status_t hm_insert(hashmap_t **const map, const void *const key, const void *const value);
 
 
+/*
+* Inserts `n` mappings from packed arrays of keys and values (`key_size` / `value_size` bytes each).
+* Map grows at most once beforehand, hashing is batched.
+* Keys already present keep their values, `HM_ALREADY_EXISTS` is returned then.
+*/
+hm_status_t hm_insert_many(hashmap_t **const map,
+        const void *const keys, const void *const values, const size_t n);
+
+
 /*
 * Reserve uninitialized space for the key.
 * Won't fail if the key exists.
+* Grows the map once used and deleted slots reach `max_load_factor` of its capacity.
+* With `resize_step` set, the previous table is kept and migrated
+* by `resize_step` slots on each following reserve / remove.
 */
 hm_status_t hm_reserve(hashmap_t **const map, const void *const key, void **const value_out);
 
@@ -86,10 +261,23 @@ hm_status_t hm_upsert(hashmap_t **const map, const void *const key, const void *
 /*
 * Remove key from hash map. If key is missing,
 * then an operation considered successfull.
+* In robin hood mode following entries are moved, so pointers to values are invalidated.
 */
 void hm_remove(hashmap_t *const map, const void *const key);
 
 
+/*
+* Variable length key variants of the calls above, `var_keys` maps only.
+* Key bytes are copied into the map's arena, which is compacted on rehash.
+* Keys stored in the map (as passed to callbacks or returned by `hm_keys`) are `hm_key_t`.
+*/
+hm_status_t hm_insert_var(hashmap_t **const map, const void *const key, const size_t size, const void *const value);
+hm_status_t hm_reserve_var(hashmap_t **const map, const void *const key, const size_t size, void **const value_out);
+hm_status_t hm_upsert_var(hashmap_t **const map, const void *const key, const size_t size, const void *const value);
+void *hm_get_var(const hashmap_t *const map, const void *const key, const size_t size);
+void hm_remove_var(hashmap_t *const map, const void *const key, const size_t size);
+
+
 /*
 * Returns current hashmap capacity.
 */
@@ -102,12 +290,80 @@ size_t hm_capacity(const hashmap_t *const map);
 size_t hm_count(const hashmap_t *const map);
 
 
+/*
+* Returns amount of slots occupied by removed mappings (tombstones).
+* Tombstones are purged on rehash.
+*/
+size_t hm_tombstones(const hashmap_t *const map);
+
+
+/*
+* Fills `out` with occupancy, probe distances and clustering of the map's tables
+* (the old one included while it is migrated), walking every slot.
+*/
+void hm_stats(const hashmap_t *const map, hm_stats_t *const out);
+
+
 /*
 * Access mapping's value via it's key.
 */
 void *hm_get(const hashmap_t *const map, const void *const key);
 
 
+/*
+* Looks up `n` keys packed one after another (`key_size` bytes each).
+* Hashes and prefetches home slots of several keys before probing any of them,
+* so cache misses of independent lookups overlap.
+* `values_out[i]` receives pointer to the value of `i`-th key or NULL when missing.
+* Returns amount of keys found.
+*/
+size_t hm_get_batch(const hashmap_t *const map, const void *const keys, const size_t n, void **const values_out);
+
+
+/*
+* Same as `hm_get_batch`, but only reports presence of the keys.
+* `found_out` is optional, returns amount of keys found.
+*/
+size_t hm_contains_batch(const hashmap_t *const map, const void *const keys, const size_t n, bool *const found_out);
+
+
+/*
+* Starts probing the map and its old table for keys with `hash` code,
+* which is the code `hashfunc` gives (variable length keys are hashed by their contents).
+* Lets the caller compare keys itself, type specialized maps (hm_typed.h) are built on it.
+*/
+hm_probe_t hm_probe(const hashmap_t *const map, const hash_t hash);
+
+
+/*
+* Advances the probe to the next stored key which hash fragment matches and points
+* `key` and `value` (both optional) right into the map's storage.
+* Returns false when probe sequences of the map and its old table end.
+* Every returned key counts as a key compare in `hm_stats`.
+* Map must not be modified while probing.
+*/
+bool hm_probe_next(hm_probe_t *const probe, const void **const key, void **const value);
+
+
+/*
+* Removes the mapping the probe stopped at.
+*/
+void hm_probe_erase(hashmap_t *const map, const hm_probe_t *const probe);
+
+
+/*
+* Inserts the key that is known to be missing in the map and its old table,
+* growing the map when needed. `hash` is the code `hashfunc` gives for the key.
+*/
+hm_status_t hm_insert_absent_(hashmap_t **const map, const void *const key, const hash_t hash, void **const value_out);
+
+
+/*
+* Called before writing into the value stored in the map or in its old table.
+*/
+void hm_touch_value_(const hashmap_t *const map, const void *const value);
+
+
 /*
 * Shrink hashmap and perform rehash,
 * reserving free space portion of currently stored elements
@@ -116,10 +372,26 @@ void *hm_get(const hashmap_t *const map, const void *const key);
 *    = 0.0f -> do not reserve any space
 *    = 1.0f -> reserve as match free space as elements currently stored, etc...
 *  ).
+* Capacity never gets below the one that keeps elements under `max_load_factor`.
 */
 hm_status_t hm_shrink_reserve(hashmap_t **const map, const float reserve);
 
 
+/*
+* Purges tombstones rehashing mappings within existing storage,
+* no memory is allocated. Capacity stays the same.
+* Pointers to values are invalidated.
+*/
+void hm_compact(hashmap_t *const map);
+
+
+/*
+* Removes all mappings keeping the storage, capacity stays the same.
+* Table under incremental migration is released, nothing else is freed.
+*/
+void hm_clear(hashmap_t *const map);
+
+
 /*
 * Returns key's subset.
 */
@@ -132,6 +404,44 @@ vector_t *hm_keys(const hashmap_t *const map);
 vector_t *hm_values(const hashmap_t *const map);
 
 
+/*
+* Creates iterator positioned before the first mapping.
+*/
+hm_iter_t hm_iter(const hashmap_t *const map);
+
+
+/*
+* Advances iterator to the next mapping and points `key` and `value` (both optional)
+* right into the map's storage. Returns false when there are no more mappings.
+* Slots are scanned by 64 control bytes at a time, empty regions are skipped at once.
+* Map must not be modified during iteration, values may be written through.
+*/
+bool hm_iter_next(hm_iter_t *const it, const void **const key, void **const value);
+
+
+/*
+* Copies up to `cap` mappings the iterator advances over into dense arrays:
+* keys go to `keys` (`key_size` bytes apart), values to `values` (`value_size` bytes apart),
+* either of them may be NULL. Returns amount of copied mappings, fewer than `cap` at the end.
+*/
+size_t hm_iter_entries(hm_iter_t *const it, void *const keys, void *const values, const size_t cap);
+
+
+/*
+* Fill caller's buffer with up to `cap` keys / values / both, single pass, no allocation.
+* Returns amount of copied elements. @see hm_iter_entries
+*/
+size_t hm_keys_into(const hashmap_t *const map, void *const buf, const size_t cap);
+size_t hm_values_into(const hashmap_t *const map, void *const buf, const size_t cap);
+size_t hm_entries_into(const hashmap_t *const map, void *const keys, void *const values, const size_t cap);
+
+
+/*
+* Exposes slot arrays of the map without copying, `spans` has room for `HM_MAX_SPANS`.
+* Returns amount of filled spans. Views are valid until the map is modified.
+*/
+size_t hm_entries_span(const hashmap_t *const map, hm_span_t *const spans);
+
 
 /** @see vector_foreach */
 int hm_foreach(const hashmap_t *const map,
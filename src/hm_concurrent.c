@@ -0,0 +1,358 @@
+#include "hm_concurrent.h"
+#include "hm_internal.h"
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_LINE 64
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() ((void)0)
+#endif
+
+/*
+* Reader handles take a cache line each, readers write only their own line.
+*/
+struct hm_reader
+{
+    _Alignas(CACHE_LINE) _Atomic uint64_t epoch; /* global epoch at the start of a lookup, 0 - idle */
+    atomic_bool taken;
+    hm_concurrent_t *owner;
+};
+
+typedef struct retired
+{
+    struct retired *next;
+    hashmap_t *table;
+    uint64_t epoch; /* global epoch the table was replaced at */
+}
+retired_t;
+
+struct hm_concurrent
+{
+    /* written by the writer only, read by everyone */
+    _Alignas(CACHE_LINE) _Atomic(hashmap_t*) table;
+    _Atomic uint64_t seq;   /* odd while the writer modifies the table */
+    _Atomic uint64_t epoch; /* incremented each time a table is replaced */
+
+    /* immutable and writer private data */
+    _Alignas(CACHE_LINE) hashfunc_t hashfunc;
+    uint64_t seed; /* of the built-in kernel, tables keep it across rehashes */
+    size_t key_size;
+    size_t value_size;
+    retired_t *retired; /* replaced tables waiting for readers to leave them */
+
+    hm_reader_t readers[HM_MAX_READERS];
+};
+
+/***                          ***
+* === forward declarations  === *
+***                          ***/
+
+static void write_begin(hm_concurrent_t *const map);
+static void write_end(hm_concurrent_t *const map);
+static hm_status_t ensure_room(hm_concurrent_t *const map);
+static void reclaim(hm_concurrent_t *const map);
+
+/***                       ***
+* === API implementation === *
+***                       ***/
+
+hm_concurrent_t *hm_concurrent_create_(const hm_opts_t *const opts)
+{
+    assert(opts);
+    assert(!opts->var_keys && "variable length keys are not supported");
+    assert(HM_PROBING_LINEAR == opts->probing && "only linear probing is supported");
+    assert(!opts->resize_step && "incremental resize is not supported");
+
+    hm_concurrent_t *map = aligned_alloc(CACHE_LINE, sizeof(hm_concurrent_t));
+    if (!map) return NULL;
+
+    hashmap_t *table = hm_create_(opts);
+    if (!table)
+    {
+        free(map);
+        return NULL;
+    }
+
+    atomic_init(&map->table, table);
+    atomic_init(&map->seq, 0);
+    atomic_init(&map->epoch, 1);
+    map->hashfunc = opts->hashfunc;
+    map->seed = ((const hm_header_t*)vector_get_ext_header(table))->seed;
+    map->key_size = opts->key_size;
+    map->value_size = opts->value_size;
+    map->retired = NULL;
+
+    for (size_t i = 0; i < HM_MAX_READERS; ++i)
+    {
+        atomic_init(&map->readers[i].epoch, 0);
+        atomic_init(&map->readers[i].taken, false);
+        map->readers[i].owner = map;
+    }
+
+    return map;
+}
+
+
+void hm_concurrent_destroy(hm_concurrent_t *const map)
+{
+    assert(map);
+
+    while (map->retired)
+    {
+        retired_t *next = map->retired->next;
+        hm_destroy(map->retired->table);
+        free(map->retired);
+        map->retired = next;
+    }
+
+    hm_destroy(atomic_load_explicit(&map->table, memory_order_relaxed));
+    free(map);
+}
+
+
+hm_reader_t *hm_reader_register(hm_concurrent_t *const map)
+{
+    assert(map);
+
+    for (size_t i = 0; i < HM_MAX_READERS; ++i)
+    {
+        if (!atomic_load_explicit(&map->readers[i].taken, memory_order_relaxed)
+            && !atomic_exchange(&map->readers[i].taken, true))
+        {
+            return &map->readers[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+void hm_reader_unregister(hm_reader_t *const reader)
+{
+    assert(reader);
+    assert(0 == atomic_load_explicit(&reader->epoch, memory_order_relaxed));
+
+    atomic_store(&reader->taken, false);
+}
+
+
+bool hm_concurrent_get(hm_reader_t *const reader, const void *const key, void *const value_out)
+{
+    assert(reader);
+    assert(key);
+
+    hm_concurrent_t *map = reader->owner;
+    const hash_t hash = hm_hash_key(map->hashfunc, map->seed, key, map->key_size);
+    bool found;
+
+    /* tables retired from now on are kept until the epoch is cleared */
+    atomic_store(&reader->epoch, atomic_load(&map->epoch));
+
+    for (;;)
+    {
+        const uint64_t seq = atomic_load_explicit(&map->seq, memory_order_acquire);
+        if (seq & 1)
+        {
+            cpu_relax();
+            continue;
+        }
+
+        /* the table may be modified under our feet, torn reads are discarded below */
+        const hashmap_t *table = atomic_load(&map->table);
+        const void *stored_value = hm_get_hashed_(table, key, hash);
+        if (stored_value && value_out)
+        {
+            memcpy(value_out, stored_value, map->value_size);
+        }
+        found = (NULL != stored_value);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (seq == atomic_load_explicit(&map->seq, memory_order_relaxed)) break;
+    }
+
+    atomic_store_explicit(&reader->epoch, 0, memory_order_release);
+    return found;
+}
+
+
+hm_status_t hm_concurrent_insert(hm_concurrent_t *const map, const void *const key, const void *const value)
+{
+    assert(map);
+    assert(key);
+    assert(value);
+
+    const hm_status_t status = ensure_room(map);
+    if (HM_SUCCESS != status) return status;
+
+    hashmap_t *table = atomic_load_explicit(&map->table, memory_order_relaxed);
+    const hash_t hash = hm_hash_key(map->hashfunc, map->seed, key, map->key_size);
+
+    if (hm_get_hashed_(table, key, hash)) return HM_ALREADY_EXISTS;
+
+    write_begin(map);
+
+    void *stored_value;
+    const hm_status_t reserved = hm_reserve_hashed_(&table, key, hash, &stored_value);
+    assert(table == atomic_load_explicit(&map->table, memory_order_relaxed) && "table grew in place");
+    if (HM_SUCCESS == reserved)
+    {
+        memcpy(stored_value, value, map->value_size);
+    }
+
+    write_end(map);
+    return reserved;
+}
+
+
+hm_status_t hm_concurrent_upsert(hm_concurrent_t *const map, const void *const key, const void *const value)
+{
+    assert(map);
+    assert(key);
+    assert(value);
+
+    const hm_status_t status = ensure_room(map);
+    if (HM_SUCCESS != status) return status;
+
+    hashmap_t *table = atomic_load_explicit(&map->table, memory_order_relaxed);
+    const hash_t hash = hm_hash_key(map->hashfunc, map->seed, key, map->key_size);
+
+    write_begin(map);
+
+    void *stored_value;
+    hm_status_t reserved = hm_reserve_hashed_(&table, key, hash, &stored_value);
+    assert(table == atomic_load_explicit(&map->table, memory_order_relaxed) && "table grew in place");
+    if (HM_SUCCESS == reserved || HM_ALREADY_EXISTS == reserved)
+    {
+        memcpy(stored_value, value, map->value_size);
+        reserved = HM_SUCCESS;
+    }
+
+    write_end(map);
+    return reserved;
+}
+
+
+void hm_concurrent_remove(hm_concurrent_t *const map, const void *const key)
+{
+    assert(map);
+    assert(key);
+
+    hashmap_t *table = atomic_load_explicit(&map->table, memory_order_relaxed);
+    const hash_t hash = hm_hash_key(map->hashfunc, map->seed, key, map->key_size);
+
+    if (!hm_get_hashed_(table, key, hash)) return;
+
+    write_begin(map);
+    hm_remove_hashed_(table, key, hash);
+    write_end(map);
+
+    reclaim(map);
+}
+
+
+size_t hm_concurrent_count(const hm_concurrent_t *const map)
+{
+    assert(map);
+
+    return hm_count(atomic_load_explicit(&map->table, memory_order_relaxed));
+}
+
+/***                     ***
+* === static functions === *
+***                     ***/
+
+/*
+* Makes sequence odd, readers started before get retried.
+*/
+static void write_begin(hm_concurrent_t *const map)
+{
+    const uint64_t seq = atomic_load_explicit(&map->seq, memory_order_relaxed);
+    atomic_store_explicit(&map->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+
+static void write_end(hm_concurrent_t *const map)
+{
+    const uint64_t seq = atomic_load_explicit(&map->seq, memory_order_relaxed);
+    atomic_store_explicit(&map->seq, seq + 1, memory_order_release);
+}
+
+
+/*
+* Guarantees that the next insertion doesn't grow the table in place:
+* a full table is copied aside (doubled, or just without tombstones)
+* and published, readers keep using the old one until they are done.
+*/
+static hm_status_t ensure_room(hm_concurrent_t *const map)
+{
+    reclaim(map);
+
+    hashmap_t *table = atomic_load_explicit(&map->table, memory_order_relaxed);
+    const hm_header_t *header = vector_get_ext_header(table);
+
+    if (header->used + header->deleted < header->growth_limit) return HM_SUCCESS;
+
+    const size_t capacity = hm_capacity(table);
+    const size_t new_cap = (2 * header->used >= header->growth_limit) ? 2 * capacity : capacity;
+
+    retired_t *retired = malloc(sizeof(retired_t));
+    if (!retired) return (hm_status_t)VECTOR_ALLOC_ERROR;
+
+    hashmap_t *new = hm_rehashed_copy_(table, new_cap);
+    if (!new)
+    {
+        free(retired);
+        return (hm_status_t)VECTOR_ALLOC_ERROR;
+    }
+
+    /* readers that see the new epoch are guaranteed to load the new table */
+    atomic_store(&map->table, new);
+
+    *retired = (retired_t){
+        .next = map->retired,
+        .table = table,
+        .epoch = atomic_fetch_add(&map->epoch, 1) + 1,
+    };
+    map->retired = retired;
+
+    return HM_SUCCESS;
+}
+
+
+/*
+* Releases retired tables no active reader could have loaded.
+*/
+static void reclaim(hm_concurrent_t *const map)
+{
+    if (!map->retired) return;
+
+    uint64_t oldest = UINT64_MAX;
+
+    for (size_t i = 0; i < HM_MAX_READERS; ++i)
+    {
+        const uint64_t epoch = atomic_load(&map->readers[i].epoch);
+        if (epoch && epoch < oldest) oldest = epoch;
+    }
+
+    for (retired_t **link = &map->retired; *link; )
+    {
+        retired_t *retired = *link;
+
+        if (retired->epoch <= oldest)
+        {
+            *link = retired->next;
+            hm_destroy(retired->table);
+            free(retired);
+        }
+        else
+        {
+            link = &retired->next;
+        }
+    }
+}
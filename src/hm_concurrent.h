@@ -0,0 +1,78 @@
+#ifndef _HM_CONCURRENT_H_
+#define _HM_CONCURRENT_H_
+
+/*
+* Read optimized hashmap for many concurrent readers and a single writer.
+*
+* Readers take no locks and write no shared cache lines:
+* a lookup is retried when the sequence counter of the map shows
+* that the writer changed the table meanwhile (seqlock).
+* Growth builds a new table aside and publishes it with a single atomic store,
+* the old table is released once no reader that could have seen it is active (epochs).
+*
+* Only linear probing with fixed size keys is supported,
+* incremental resize doesn't apply (tables are always replaced at once).
+*/
+
+#include "hashmap.h"
+
+#ifndef HM_MAX_READERS
+#define HM_MAX_READERS 64
+#endif
+
+typedef struct hm_concurrent hm_concurrent_t;
+typedef struct hm_reader hm_reader_t;
+
+
+/*
+* The wrapper for `hm_concurrent_create_` function that provides default values.
+*/
+#define hm_concurrent_create(...) \
+    hm_concurrent_create_(&(hm_opts_t){ \
+        .capacity = 256, \
+        .max_load_factor = HM_DEFAULT_MAX_LOAD_FACTOR, \
+        __VA_ARGS__ \
+    })
+
+/*
+* Creates concurrent hashmap.
+*/
+hm_concurrent_t *hm_concurrent_create_(const hm_opts_t *const opts);
+
+
+/*
+* Release concurrent hashmap resources, no readers are allowed to be active.
+*/
+void hm_concurrent_destroy(hm_concurrent_t *const map);
+
+
+/*
+* Each reader thread takes its own handle once and uses it for every lookup.
+* Returns NULL when all `HM_MAX_READERS` handles are taken.
+*/
+hm_reader_t *hm_reader_register(hm_concurrent_t *const map);
+void hm_reader_unregister(hm_reader_t *const reader);
+
+
+/*
+* Lock-free lookup, copies the value into `value_out` (optional).
+* Returns false when the key is missing.
+*/
+bool hm_concurrent_get(hm_reader_t *const reader, const void *const key, void *const value_out);
+
+
+/*
+* Writer calls, counterparts of `hm_insert`, `hm_upsert` and `hm_remove`.
+* Only one thread at a time may call them.
+*/
+hm_status_t hm_concurrent_insert(hm_concurrent_t *const map, const void *const key, const void *const value);
+hm_status_t hm_concurrent_upsert(hm_concurrent_t *const map, const void *const key, const void *const value);
+void hm_concurrent_remove(hm_concurrent_t *const map, const void *const key);
+
+
+/*
+* Returns amount of mappings, writer only.
+*/
+size_t hm_concurrent_count(const hm_concurrent_t *const map);
+
+#endif/*_HM_CONCURRENT_H_*/
@@ -0,0 +1,204 @@
+#ifndef _HM_CTRL_H_
+#define _HM_CTRL_H_
+
+/*
+* Control bytes and group matching used by hashmap probing.
+*
+* Each slot owns one control byte: `HM_CTRL_EMPTY`, `HM_CTRL_DELETED` or
+* 7-bit hash fragment of the stored key (top bit clear) for used slots.
+* Group of `HM_GROUP_WIDTH` consecutive control bytes is matched at once
+* with SSE2 / AVX2 when available, or 8 bytes at a time in a 64-bit word otherwise.
+* `HM_NO_SIMD` forces the portable implementation, it comes from hm_config.h
+* (configure --disable-simd), so the library and code including this header agree.
+*/
+
+#include "hm_config.h"
+#include <stdint.h>
+#include <string.h>
+
+typedef int8_t ctrl_t;
+
+#define HM_CTRL_EMPTY   ((ctrl_t)-128) /* 0b10000000 */
+#define HM_CTRL_DELETED ((ctrl_t)-2)   /* 0b11111110 */
+
+#if defined(__AVX2__) && !defined(HM_NO_SIMD)
+#   include <immintrin.h>
+#   define HM_GROUP_WIDTH 32
+#   define HM_MASK_SHIFT 0
+    typedef __m256i hm_group_t;
+    typedef uint32_t hm_mask_t;
+#elif defined(__SSE2__) && !defined(HM_NO_SIMD)
+#   include <emmintrin.h>
+#   define HM_GROUP_WIDTH 16
+#   define HM_MASK_SHIFT 0
+    typedef __m128i hm_group_t;
+    typedef uint32_t hm_mask_t;
+#else
+#   define HM_GROUP_WIDTH 8
+#   define HM_MASK_SHIFT 3 /* matches are reported in the top bit of each byte */
+    typedef uint64_t hm_group_t;
+    typedef uint64_t hm_mask_t;
+#endif
+
+#define HM_MASK_BITS (HM_GROUP_WIDTH << HM_MASK_SHIFT)
+
+
+static inline int ctrl_is_full(const ctrl_t ctrl)
+{
+    return ctrl >= 0;
+}
+
+
+#if defined(__AVX2__) && !defined(HM_NO_SIMD)
+
+static inline hm_group_t group_load(const ctrl_t *const ctrl)
+{
+    return _mm256_loadu_si256((const __m256i*)ctrl);
+}
+
+static inline hm_mask_t group_match(const hm_group_t group, const ctrl_t h2)
+{
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_set1_epi8(h2), group));
+}
+
+static inline hm_mask_t group_match_empty(const hm_group_t group)
+{
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_set1_epi8(HM_CTRL_EMPTY), group));
+}
+
+static inline hm_mask_t group_match_empty_or_deleted(const hm_group_t group)
+{
+    return (uint32_t)_mm256_movemask_epi8(group);
+}
+
+static inline hm_mask_t group_match_full(const hm_group_t group)
+{
+    return ~(uint32_t)_mm256_movemask_epi8(group);
+}
+
+#elif defined(__SSE2__) && !defined(HM_NO_SIMD)
+
+static inline hm_group_t group_load(const ctrl_t *const ctrl)
+{
+    return _mm_loadu_si128((const __m128i*)ctrl);
+}
+
+static inline hm_mask_t group_match(const hm_group_t group, const ctrl_t h2)
+{
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), group));
+}
+
+static inline hm_mask_t group_match_empty(const hm_group_t group)
+{
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(HM_CTRL_EMPTY), group));
+}
+
+static inline hm_mask_t group_match_empty_or_deleted(const hm_group_t group)
+{
+    return (uint32_t)_mm_movemask_epi8(group);
+}
+
+static inline hm_mask_t group_match_full(const hm_group_t group)
+{
+    return ~(uint32_t)_mm_movemask_epi8(group) & 0xffffu;
+}
+
+#else
+
+#define HM_LSBS 0x0101010101010101ull
+#define HM_MSBS 0x8080808080808080ull
+
+static inline hm_group_t group_load(const ctrl_t *const ctrl)
+{
+    uint64_t group;
+    memcpy(&group, ctrl, sizeof(group));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    group = __builtin_bswap64(group);
+#endif
+    return group;
+}
+
+/*
+* May report false positives for full slots right after a true match,
+* callers compare keys anyway.
+*/
+static inline hm_mask_t group_match(const hm_group_t group, const ctrl_t h2)
+{
+    const uint64_t x = group ^ (HM_LSBS * (uint8_t)h2);
+    return (x - HM_LSBS) & ~x & HM_MSBS;
+}
+
+static inline hm_mask_t group_match_empty(const hm_group_t group)
+{
+    /* only empty byte has the top bit set and the second lowest bit clear */
+    return group & ~(group << 6) & HM_MSBS;
+}
+
+static inline hm_mask_t group_match_empty_or_deleted(const hm_group_t group)
+{
+    return group & HM_MSBS;
+}
+
+static inline hm_mask_t group_match_full(const hm_group_t group)
+{
+    return ~group & HM_MSBS;
+}
+
+#endif
+
+
+/*
+* Bit per slot of 64 consecutive control bytes, set for used slots.
+*/
+static inline uint64_t ctrl_match_full64(const ctrl_t *const ctrl)
+{
+    uint64_t mask = 0;
+#if HM_MASK_SHIFT
+    for (unsigned int i = 0; i < 64; i += HM_GROUP_WIDTH)
+    {
+        /* gather top bit of each byte into the lowest byte */
+        const uint64_t full = group_match_full(group_load(ctrl + i)) >> 7;
+        mask |= ((full * 0x0102040810204080ull) >> 56) << i;
+    }
+#else
+    for (unsigned int i = 0; i < 64; i += HM_GROUP_WIDTH)
+    {
+        mask |= (uint64_t)group_match_full(group_load(ctrl + i)) << i;
+    }
+#endif
+    return mask;
+}
+
+
+/*
+* Offset of the first matched slot in the group.
+*/
+static inline unsigned int mask_lowest(const hm_mask_t mask)
+{
+    return (unsigned int)__builtin_ctzll(mask) >> HM_MASK_SHIFT;
+}
+
+static inline hm_mask_t mask_clear_lowest(const hm_mask_t mask)
+{
+    return mask & (mask - 1);
+}
+
+/*
+* Amount of unmatched slots at the start of the group.
+*/
+static inline unsigned int mask_trailing_zeros(const hm_mask_t mask)
+{
+    return mask ? mask_lowest(mask) : HM_GROUP_WIDTH;
+}
+
+/*
+* Amount of unmatched slots at the end of the group.
+*/
+static inline unsigned int mask_leading_zeros(const hm_mask_t mask)
+{
+    return mask
+        ? (unsigned int)(__builtin_clzll(mask) - (64 - HM_MASK_BITS)) >> HM_MASK_SHIFT
+        : HM_GROUP_WIDTH;
+}
+
+#endif/*_HM_CTRL_H_*/
@@ -0,0 +1,223 @@
+#ifndef _HM_INTERNAL_H_
+#define _HM_INTERNAL_H_
+
+/*
+* Hashmap layout and probing primitives shared by the library sources.
+* Not installed, code built against the library goes through hashmap.h
+* (type specialized maps probe with `hm_probe`), so the layout may change freely.
+*/
+
+#include "hashmap.h"
+#include "hm_config.h"
+#include "hm_ctrl.h"
+#include "hm_kernels.h"
+#include <stdint.h>
+
+#define HM_SLOT_ALIGNMENT sizeof(size_t)
+#define HM_ALIGNED_SIZE(size) (((size) + HM_SLOT_ALIGNMENT - 1) / HM_SLOT_ALIGNMENT * HM_SLOT_ALIGNMENT)
+
+typedef struct hm_header
+{
+    alloc_opts_t alloc_opts;
+    size_t key_size;
+    size_t aligned_key_size;
+    size_t value_size;
+    size_t slot_size;
+    size_t hash_offset; /* offset of the cached hash code within the slot, 0 - not cached */
+    hashfunc_t hashfunc; /* NULL - built-in kernels seeded with `seed` */
+    uint64_t seed;
+    float max_load_factor;
+    hm_capacity_policy_t capacity_policy;
+    hm_probing_t probing;
+    size_t capacity;
+    unsigned int shift;  /* 64 - log2(capacity) for power of two capacities */
+    size_t growth_limit; /* amount of used and deleted slots that triggers growth */
+    char *slots;         /* first slot, vector storage never moves */
+    ctrl_t *ctrl;        /* control byte per slot followed by a copy of the first group,
+                            robin hood probe distances per slot go next (stored after the header) */
+
+    size_t used;    /* amount of slots holding mappings */
+    size_t deleted; /* amount of slots marked as deleted (tombstones) */
+
+    size_t resize_step; /* old slots migrated per operation, 0 - resize at once */
+    hashmap_t *old;     /* table being migrated by incremental resize */
+    size_t migrated;    /* next slot of the old table to migrate */
+    size_t nthreads;    /* threads placing mappings on rehash and build */
+    hm_pages_t pages;
+    hm_numa_t numa;
+    unsigned long numa_nodes;
+
+    bool var_keys;
+    struct arena_block *arena; /* current block of variable length keys storage */
+    size_t arena_bytes;        /* bytes taken from the arena */
+    size_t garbage;            /* bytes of removed keys left in the arena */
+
+    uint64_t a; /* random factors for multiply-shift hashing (`a` is odd) */
+    uint64_t b;
+
+    void *mapping;       /* file image or pages holding control bytes and slots, NULL - vector storage */
+    size_t mapping_size;
+    void (*unmap) (void *const mapping, const size_t size);
+
+    struct hm_snapshot *snapshots; /* snapshots sharing chunks of this table */
+    bool orphaned;                 /* destroyed while snapshots still read it */
+
+    size_t rehashes;   /* tables the map moved through, carried over to the next table */
+    uint64_t lookups;  /* hot path counters, updated only when configured with HM_STATS_COUNTERS */
+    uint64_t probes;
+    uint64_t compares;
+}
+hm_header_t;
+
+
+/*
+* Mixes hash code utilizing multiply-shift hashing: (a*h + b) mod 2^64.
+*/
+static inline uint64_t hm_mix_hash(const hm_header_t *header, const hash_t hash)
+{
+    return header->a * (uint64_t)hash + header->b;
+}
+
+
+/*
+* Hash code of key bytes the map gives, variable length keys are hashed by their contents.
+*/
+static inline hash_t hm_hash_bytes(const hm_header_t *header, const void *const data, const size_t size)
+{
+    return hm_hash_key(header->hashfunc, header->seed, data, size);
+}
+
+
+/*
+* Calculates index from high bits of the mixed hash.
+* Arbitrary capacities use multiply-high "fast range" reduction, no division involved.
+*/
+static inline size_t hm_hash_to_index(const hm_header_t *header, const uint64_t mixed, const size_t capacity)
+{
+    if (HM_CAPACITY_POW2 == header->capacity_policy)
+    {
+        return (size_t)(mixed >> header->shift);
+    }
+#ifdef __SIZEOF_INT128__
+    return (size_t)(((unsigned __int128)mixed * capacity) >> 64);
+#else
+    return (size_t)(((mixed >> 32) * (uint32_t)capacity) >> 32); /* capacity below 2^32 */
+#endif
+}
+
+
+/*
+* 7-bit hash fragment stored in control byte of the used slot.
+*/
+static inline ctrl_t hm_hash_to_fragment(const uint64_t mixed)
+{
+    return (ctrl_t)((mixed ^ (mixed >> 32)) & 0x7f);
+}
+
+
+/*
+* Wraps index that went past the capacity, `index` must be below 2 * capacity.
+*/
+static inline size_t hm_wrap_index(const hm_header_t *header, const size_t index, const size_t capacity)
+{
+    if (HM_CAPACITY_POW2 == header->capacity_policy)
+    {
+        return index & (capacity - 1);
+    }
+    return (index >= capacity) ? index - capacity : index;
+}
+
+
+/*
+* Hot path counters of `hm_stats` go into `stats` header, NULL - not counted.
+* Compiled in when the library is configured with --enable-stats-counters (hm_config.h),
+* probing happens only in library sources, so every lookup is counted the same way.
+*/
+#ifdef HM_STATS_COUNTERS
+#   define HM_COUNT(stats, counter) ((stats) ? (void)++(stats)->counter : (void)0)
+#else
+#   define HM_COUNT(stats, counter) ((void)(stats))
+#endif
+
+
+/*
+* Copy-on-write snapshots (see hm_snapshot.c) get their own copy of the chunk holding the slot
+* before the slot or its control byte is changed, or all chunks at once.
+*/
+void hm_snapshot_preserve_(const hm_header_t *const header, const size_t index);
+void hm_snapshot_preserve_all_(const hm_header_t *const header);
+
+
+/*
+* Called before writing into the slot of the table.
+*/
+static inline void hm_touch_slot(const hm_header_t *header, const size_t index)
+{
+    if (header->snapshots) hm_snapshot_preserve_(header, index);
+}
+
+
+/*
+* Calls taking hash code of the key computed by the caller with map's `hashfunc`
+* (variable length keys are hashed by their contents).
+*/
+void *hm_get_hashed_(const hashmap_t *const map, const void *const key, const hash_t hash);
+hm_status_t hm_reserve_hashed_(hashmap_t **const map, const void *const key, const hash_t hash, void **const value_out);
+void hm_remove_hashed_(hashmap_t *const map, const void *const key, const hash_t hash);
+
+
+/*
+* Removes mapping at `index` of the `table`, which is the map itself or its old table.
+*/
+void hm_erase_at_(hashmap_t *const map, hashmap_t *const table, const size_t index);
+
+
+/*
+* Fills `size` bytes with randomness of the OS (`getrandom`),
+* for seeds and hashing factors that can't be guessed from the outside.
+*/
+void hm_random_(void *const dst, const size_t size);
+
+
+/*
+* Copies all mappings into a new table of at least `new_cap` slots,
+* the source map stays untouched. Returns NULL on allocation failure.
+*/
+hashmap_t *hm_rehashed_copy_(const hashmap_t *const map, size_t new_cap);
+
+
+/*
+* Creates empty map header for a table living in external memory (a mapped file image),
+* `hm_mmap.c` fills the rest of it.
+*/
+hashmap_t *hm_create_mapped_(const hm_opts_t *const opts, const size_t capacity,
+        ctrl_t *const ctrl, char *const slots);
+
+
+/*
+* Anonymous mapping of at least `*size` bytes for a table, with page and memory policies
+* of `opts` applied where the system supports them (see hm_pages.c), `*size` gets rounded up.
+* Returns NULL when pages can't be mapped.
+*/
+void *hm_pages_map_(const hm_opts_t *const opts, size_t *const size);
+void hm_pages_unmap_(void *const mapping, const size_t size);
+
+
+/*
+* Fills `size` bytes with `byte` by `nthreads` threads, so each page is touched first
+* by one of them. Single threaded when threads can't be started.
+*/
+void hm_pages_fill_(void *const dst, const int byte, const size_t size, const size_t nthreads);
+
+
+/*
+* Multithreaded placement into an empty linear probing map (see hm_parallel.c):
+* all mappings of `src` that has no old table, or packed arrays of keys and values
+* of fixed size (duplicate keys keep the first value).
+* Nothing is placed when allocation fails.
+*/
+hm_status_t hm_place_all_parallel_(hashmap_t *const dst, const hashmap_t *const src, const size_t nthreads);
+hm_status_t hm_place_many_parallel_(hashmap_t *const dst,
+        const void *const keys, const void *const values, const size_t n, const size_t nthreads);
+
+#endif/*_HM_INTERNAL_H_*/
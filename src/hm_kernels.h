@@ -0,0 +1,182 @@
+#ifndef _HM_KERNELS_H_
+#define _HM_KERNELS_H_
+
+/*
+* Built-in seeded hash kernels, used by maps created without `hashfunc`.
+*
+* Keys of 4, 8 and 16 bytes are hashed by specialized kernels: one folded 64x64->128 bit
+* multiply of the key with the seed and one more for the final mix.
+* Other sizes (and variable length keys) go through the wyhash construction:
+* 48 byte blocks are absorbed in three independent multiply lanes, the tail in 16 byte steps.
+* Hash codes depend on the seed, the map draws it at random so colliding keys can't be
+* precomputed. Codes are stable only for the same seed, byte order and word size.
+*/
+
+#include "hash.h"
+#include <stdint.h>
+#include <string.h>
+
+#define HM_KERNEL_P0 0xa0761d6478bd642full
+#define HM_KERNEL_P1 0xe7037ed1a0b428dbull
+#define HM_KERNEL_P2 0x8ebc6af09c88c6e3ull
+#define HM_KERNEL_P3 0x589965cc75374cc3ull
+
+
+/*
+* Full 128 bit product of `a` and `b`, low half goes into `a`, high half into `b`.
+*/
+static inline void hm_kernel_mum(uint64_t *const a, uint64_t *const b)
+{
+#ifdef __SIZEOF_INT128__
+    const unsigned __int128 r = (unsigned __int128)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    const uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+    const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    const uint64_t t = rl + (rm0 << 32);
+    const uint64_t lo = t + (rm1 << 32);
+    const uint64_t carry = (t < rl) + (lo < t);
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+#endif
+}
+
+
+/*
+* Folds both halves of the product together.
+*/
+static inline uint64_t hm_kernel_mix(uint64_t a, uint64_t b)
+{
+    hm_kernel_mum(&a, &b);
+    return a ^ b;
+}
+
+
+static inline uint64_t hm_kernel_read8(const unsigned char *const p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+
+static inline uint64_t hm_kernel_read4(const unsigned char *const p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+
+/*
+* Mixes last two words of the key with the seed and the key length.
+*/
+static inline uint64_t hm_kernel_final(uint64_t a, uint64_t b, const uint64_t seed, const size_t size)
+{
+    a ^= HM_KERNEL_P1;
+    b ^= seed;
+    hm_kernel_mum(&a, &b);
+    return hm_kernel_mix(a ^ HM_KERNEL_P0 ^ size, b ^ HM_KERNEL_P1);
+}
+
+
+static inline uint64_t hm_kernel_hash4(const uint64_t seed, const void *const data)
+{
+    const uint64_t k = hm_kernel_read4(data);
+    return hm_kernel_final(k << 32 | k, k, seed, 4);
+}
+
+
+static inline uint64_t hm_kernel_hash8(const uint64_t seed, const void *const data)
+{
+    const uint64_t k = hm_kernel_read8(data);
+    return hm_kernel_final(k, k >> 32 | k << 32, seed, 8);
+}
+
+
+static inline uint64_t hm_kernel_hash16(const uint64_t seed, const void *const data)
+{
+    const unsigned char *p = data;
+    return hm_kernel_final(hm_kernel_read8(p), hm_kernel_read8(p + 8), seed, 16);
+}
+
+
+/*
+* wyhash over `size` bytes of any length.
+*/
+static inline uint64_t hm_kernel_hash_bytes(uint64_t seed, const void *const data, const size_t size)
+{
+    const unsigned char *p = data;
+    uint64_t a = 0, b = 0;
+
+    if (size <= 16)
+    {
+        if (size >= 4)
+        {
+            const size_t step = (size >> 3) << 2;
+            a = hm_kernel_read4(p) << 32 | hm_kernel_read4(p + step);
+            b = hm_kernel_read4(p + size - 4) << 32 | hm_kernel_read4(p + size - 4 - step);
+        }
+        else if (size > 0)
+        {
+            a = (uint64_t)p[0] << 16 | (uint64_t)p[size >> 1] << 8 | p[size - 1];
+        }
+        return hm_kernel_final(a, b, seed, size);
+    }
+
+    size_t left = size;
+    if (left > 48)
+    {
+        uint64_t lane1 = seed, lane2 = seed;
+        do
+        {
+            seed = hm_kernel_mix(hm_kernel_read8(p) ^ HM_KERNEL_P1, hm_kernel_read8(p + 8) ^ seed);
+            lane1 = hm_kernel_mix(hm_kernel_read8(p + 16) ^ HM_KERNEL_P2, hm_kernel_read8(p + 24) ^ lane1);
+            lane2 = hm_kernel_mix(hm_kernel_read8(p + 32) ^ HM_KERNEL_P3, hm_kernel_read8(p + 40) ^ lane2);
+            p += 48;
+            left -= 48;
+        }
+        while (left > 48);
+        seed ^= lane1 ^ lane2;
+    }
+
+    while (left > 16)
+    {
+        seed = hm_kernel_mix(hm_kernel_read8(p) ^ HM_KERNEL_P1, hm_kernel_read8(p + 8) ^ seed);
+        p += 16;
+        left -= 16;
+    }
+
+    a = hm_kernel_read8(p + left - 16);
+    b = hm_kernel_read8(p + left - 8);
+    return hm_kernel_final(a, b, seed, size);
+}
+
+
+/*
+* Picks the kernel by key size, the branch is taken the same way for every key of a map.
+*/
+static inline uint64_t hm_kernel_hash(const uint64_t seed, const void *const data, const size_t size)
+{
+    switch (size)
+    {
+        case 4: return hm_kernel_hash4(seed, data);
+        case 8: return hm_kernel_hash8(seed, data);
+        case 16: return hm_kernel_hash16(seed, data);
+        default: return hm_kernel_hash_bytes(seed, data, size);
+    }
+}
+
+
+/*
+* Hash code of the key with `hashfunc`, or with the built-in kernel when it is NULL.
+*/
+static inline hash_t hm_hash_key(const hashfunc_t hashfunc, const uint64_t seed,
+        const void *const data, const size_t size)
+{
+    if (hashfunc) return hashfunc(data, size);
+    return (hash_t)hm_kernel_hash(seed, data, size);
+}
+
+#endif/*_HM_KERNELS_H_*/
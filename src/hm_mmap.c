@@ -0,0 +1,346 @@
+#include "hm_mmap.h"
+#include "hm_internal.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define IMAGE_MAGIC "HASHMAP"
+#define IMAGE_BYTE_ORDER 0x01020304u
+#define IMAGE_ALIGNMENT 64 /* sections start at cache line boundaries */
+
+/*
+* Fixed width image header, the table follows it at `ctrl_offset` and `slots_offset`.
+* Images are portable between builds of the same byte order, word size and group width.
+*/
+typedef struct hm_image
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t hashfunc_id;
+    uint16_t slot_alignment;
+    uint16_t group_width;
+    uint8_t capacity_policy;
+    uint8_t probing;
+    uint8_t store_hash;
+    uint8_t reserved;
+    float max_load_factor;
+
+    uint64_t key_size;
+    uint64_t value_size;
+    uint64_t capacity;
+    uint64_t used;
+    uint64_t deleted;
+    uint64_t a;
+    uint64_t b;
+    uint64_t seed;         /* of the built-in kernels */
+
+    uint64_t ctrl_offset;  /* control bytes and robin hood probe distances */
+    uint64_t slots_offset;
+    uint64_t size;         /* of the whole image */
+}
+hm_image_t;
+
+static struct
+{
+    uint32_t id;
+    hashfunc_t func;
+}
+hashfuncs[HM_MAX_HASHFUNCS];
+static size_t hashfuncs_count;
+
+/***                          ***
+* === forward declarations  === *
+***                          ***/
+
+static bool find_hashfunc_id(const hashfunc_t func, uint32_t *const id);
+static hashfunc_t find_hashfunc(const uint32_t id);
+static size_t calc_ctrl_area(const size_t capacity, const hm_probing_t probing);
+static size_t align_offset(const size_t offset);
+static bool write_image(FILE *const file, const hm_image_t *const image, const hm_header_t *const header);
+static bool write_padding(FILE *const file, const size_t from, const size_t to);
+static bool valid_image(const hm_image_t *const image, const size_t file_size);
+static void unmap(void *const mapping, const size_t size);
+
+/***                       ***
+* === API implementation === *
+***                       ***/
+
+bool hm_register_hashfunc(const uint32_t id, const hashfunc_t func)
+{
+    assert(func);
+
+    if (HM_BUILTIN_HASHFUNC_ID == id) return false;
+
+    for (size_t i = 0; i < hashfuncs_count; ++i)
+    {
+        if (hashfuncs[i].id == id) return hashfuncs[i].func == func;
+    }
+
+    if (HM_MAX_HASHFUNCS == hashfuncs_count) return false;
+
+    hashfuncs[hashfuncs_count].id = id;
+    hashfuncs[hashfuncs_count].func = func;
+    ++hashfuncs_count;
+    return true;
+}
+
+
+hm_status_t hm_save(const hashmap_t *const map, const char *const path)
+{
+    assert(map);
+    assert(path);
+
+    const hm_header_t *header = vector_get_ext_header(map);
+
+    /* slots hold pointers into the arena */
+    if (header->var_keys) return HM_UNSUPPORTED;
+
+    /* mappings waiting for incremental migration are merged first */
+    if (header->old)
+    {
+        hashmap_t *merged = hm_rehashed_copy_(map, hm_capacity(map));
+        if (!merged) return (hm_status_t)VECTOR_ALLOC_ERROR;
+
+        const hm_status_t status = hm_save(merged, path);
+        hm_destroy(merged);
+        return status;
+    }
+
+    uint32_t hashfunc_id;
+    if (!find_hashfunc_id(header->hashfunc, &hashfunc_id)) return HM_UNKNOWN_HASHFUNC;
+
+    const size_t capacity = hm_capacity(map);
+    const size_t ctrl_offset = align_offset(sizeof(hm_image_t));
+    const size_t slots_offset = align_offset(ctrl_offset + calc_ctrl_area(capacity, header->probing));
+
+    const hm_image_t image = {
+        .magic = IMAGE_MAGIC,
+        .version = HM_IMAGE_VERSION,
+        .byte_order = IMAGE_BYTE_ORDER,
+        .hashfunc_id = hashfunc_id,
+        .slot_alignment = HM_SLOT_ALIGNMENT,
+        .group_width = HM_GROUP_WIDTH,
+        .capacity_policy = header->capacity_policy,
+        .probing = header->probing,
+        .store_hash = header->hash_offset != 0,
+        .max_load_factor = header->max_load_factor,
+        .key_size = header->key_size,
+        .value_size = header->value_size,
+        .capacity = capacity,
+        .used = header->used,
+        .deleted = header->deleted,
+        .a = header->a,
+        .b = header->b,
+        .seed = header->seed,
+        .ctrl_offset = ctrl_offset,
+        .slots_offset = slots_offset,
+        .size = slots_offset + capacity * header->slot_size,
+    };
+
+    /* readers of the previous image never see a partially written one */
+    const size_t path_len = strlen(path);
+    char *tmp_path = malloc(path_len + sizeof(".tmp"));
+    if (!tmp_path) return (hm_status_t)VECTOR_ALLOC_ERROR;
+
+    memcpy(tmp_path, path, path_len);
+    memcpy(tmp_path + path_len, ".tmp", sizeof(".tmp"));
+
+    FILE *file = fopen(tmp_path, "wb");
+    bool written = file && write_image(file, &image, header);
+
+    if (file)
+    {
+        written = (0 == fflush(file)) && (0 == fsync(fileno(file))) && written;
+        written = (0 == fclose(file)) && written;
+    }
+
+    written = written && (0 == rename(tmp_path, path));
+
+    if (!written) remove(tmp_path);
+    free(tmp_path);
+
+    return written ? HM_SUCCESS : HM_IO_ERROR;
+}
+
+
+hashmap_t *hm_open_mmap(const char *const path, const hm_map_flags_t flags)
+{
+    assert(path);
+
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (0 != fstat(fd, &st) || (size_t)st.st_size < sizeof(hm_image_t))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    const size_t size = (size_t)st.st_size;
+    const int prot = (HM_MAP_COPY_ON_WRITE == flags) ? PROT_READ | PROT_WRITE : PROT_READ;
+    char *mapping = mmap(NULL, size, prot, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (MAP_FAILED == mapping) return NULL;
+
+    const hm_image_t *image = (const hm_image_t*)mapping;
+    const bool valid = valid_image(image, size);
+    const bool builtin = valid && HM_BUILTIN_HASHFUNC_ID == image->hashfunc_id;
+    const hashfunc_t hashfunc = (valid && !builtin) ? find_hashfunc(image->hashfunc_id) : NULL;
+
+    hashmap_t *map = (hashfunc || builtin)
+        ? hm_create_mapped_(
+            &(hm_opts_t){
+                .key_size = image->key_size,
+                .value_size = image->value_size,
+                .hashfunc = hashfunc,
+                .seed = image->seed,
+                .max_load_factor = image->max_load_factor,
+                .capacity_policy = image->capacity_policy,
+                .probing = image->probing,
+                .store_hash = image->store_hash,
+            },
+            image->capacity,
+            (ctrl_t*)(mapping + image->ctrl_offset),
+            mapping + image->slots_offset)
+        : NULL;
+
+    if (!map)
+    {
+        munmap(mapping, size);
+        return NULL;
+    }
+
+    hm_header_t *header = vector_get_ext_header(map);
+    header->used = image->used;
+    header->deleted = image->deleted;
+    header->a = image->a;
+    header->b = image->b;
+    header->mapping = mapping;
+    header->mapping_size = size;
+    header->unmap = unmap;
+
+    return map;
+}
+
+/***                     ***
+* === static functions === *
+***                     ***/
+
+static bool find_hashfunc_id(const hashfunc_t func, uint32_t *const id)
+{
+    if (!func)
+    {
+        *id = HM_BUILTIN_HASHFUNC_ID;
+        return true;
+    }
+
+    for (size_t i = 0; i < hashfuncs_count; ++i)
+    {
+        if (hashfuncs[i].func == func)
+        {
+            *id = hashfuncs[i].id;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static hashfunc_t find_hashfunc(const uint32_t id)
+{
+    for (size_t i = 0; i < hashfuncs_count; ++i)
+    {
+        if (hashfuncs[i].id == id) return hashfuncs[i].func;
+    }
+    return NULL;
+}
+
+
+/*
+* Control bytes with the copy of the first group and robin hood probe distances,
+* same sizes the map allocates after its header.
+*/
+static size_t calc_ctrl_area(const size_t capacity, const hm_probing_t probing)
+{
+    const size_t dist_size = (HM_PROBING_ROBIN_HOOD == probing) ? HM_ALIGNED_SIZE(capacity) : 0;
+    return HM_ALIGNED_SIZE(capacity + HM_GROUP_WIDTH) + dist_size;
+}
+
+
+static size_t align_offset(const size_t offset)
+{
+    return (offset + IMAGE_ALIGNMENT - 1) / IMAGE_ALIGNMENT * IMAGE_ALIGNMENT;
+}
+
+
+static bool write_image(FILE *const file, const hm_image_t *const image, const hm_header_t *const header)
+{
+    const size_t ctrl_area = calc_ctrl_area(image->capacity, header->probing);
+    const size_t slots_size = image->capacity * header->slot_size;
+
+    return 1 == fwrite(image, sizeof(hm_image_t), 1, file)
+        && write_padding(file, sizeof(hm_image_t), image->ctrl_offset)
+        && ctrl_area == fwrite(header->ctrl, 1, ctrl_area, file)
+        && write_padding(file, image->ctrl_offset + ctrl_area, image->slots_offset)
+        && slots_size == fwrite(header->slots, 1, slots_size, file);
+}
+
+
+static bool write_padding(FILE *const file, const size_t from, const size_t to)
+{
+    static const char zeros[IMAGE_ALIGNMENT];
+    return to == from || to - from == fwrite(zeros, 1, to - from, file);
+}
+
+
+/*
+* Checks that the image was written by a compatible build and its sections fit the file.
+*/
+static bool valid_image(const hm_image_t *const image, const size_t file_size)
+{
+    if (0 != memcmp(image->magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC))
+        || HM_IMAGE_VERSION != image->version
+        || IMAGE_BYTE_ORDER != image->byte_order
+        || HM_SLOT_ALIGNMENT != image->slot_alignment
+        || HM_GROUP_WIDTH != image->group_width
+        || image->capacity_policy > HM_CAPACITY_EXACT
+        || image->probing > HM_PROBING_ROBIN_HOOD
+        || !image->key_size || !image->value_size
+        || image->key_size > file_size || image->value_size > file_size
+        || image->capacity < HM_GROUP_WIDTH || image->capacity > file_size
+        || image->used > image->capacity || image->deleted > image->capacity - image->used
+        || !(image->max_load_factor > 0.0f && image->max_load_factor <= 1.0f))
+    {
+        return false;
+    }
+
+    if (HM_CAPACITY_POW2 == image->capacity_policy && (image->capacity & (image->capacity - 1)))
+    {
+        return false;
+    }
+
+    /* sizes and capacity are bounded by the file above, so nothing below wraps */
+    const size_t slot_size = HM_ALIGNED_SIZE(image->key_size) + HM_ALIGNED_SIZE(image->value_size)
+        + (image->store_hash ? HM_ALIGNED_SIZE(sizeof(hash_t)) : 0);
+
+    return image->ctrl_offset >= sizeof(hm_image_t)
+        && image->ctrl_offset <= file_size
+        && image->slots_offset >= image->ctrl_offset + calc_ctrl_area(image->capacity, image->probing)
+        && image->slots_offset <= file_size
+        && image->capacity <= (file_size - image->slots_offset) / slot_size
+        && image->size == image->slots_offset + image->capacity * slot_size;
+}
+
+
+static void unmap(void *const mapping, const size_t size)
+{
+    munmap(mapping, size);
+}
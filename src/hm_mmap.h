@@ -0,0 +1,53 @@
+#ifndef _HM_MMAP_H_
+#define _HM_MMAP_H_
+
+/*
+* Hashmap images on disk.
+*
+* Image is a fixed header followed by control bytes and slots exactly as they are laid out
+* in memory, addressed by offsets. Opening maps the file and points the table into it,
+* so lookups work right away without reinserting anything.
+* Hash function is stored as an id, hashing factors are kept, so mappings stay where they are.
+* Maps hashed by the built-in kernels are saved with `HM_BUILTIN_HASHFUNC_ID` and their seed.
+*
+* Maps with variable length keys can't be saved.
+*/
+
+#include "hashmap.h"
+
+#define HM_IMAGE_VERSION 2
+#define HM_MAX_HASHFUNCS 16
+#define HM_BUILTIN_HASHFUNC_ID UINT32_MAX /* reserved for maps without `hashfunc` */
+
+typedef enum hm_map_flags
+{
+    HM_MAP_READ_ONLY = 0,     /**< pages are shared with the file, map must not be modified */
+    HM_MAP_COPY_ON_WRITE = 1, /**< modified pages become private, the file stays untouched */
+}
+hm_map_flags_t;
+
+
+/*
+* Associates `id` with `func` for saving and opening images.
+* Supposed to be called at startup, before images are used. Returns false when the table is full
+* or `id` is taken by another function (`HM_BUILTIN_HASHFUNC_ID` included).
+*/
+bool hm_register_hashfunc(const uint32_t id, const hashfunc_t func);
+
+
+/*
+* Writes the image of the map into `path` (through a temporary file renamed in place).
+* Map's hashfunc has to be registered, unless the map uses the built-in kernels.
+* Maps with variable length keys are rejected with `HM_UNSUPPORTED`.
+*/
+hm_status_t hm_save(const hashmap_t *const map, const char *const path);
+
+
+/*
+* Maps the image from `path`. Growth of a copy-on-write map moves it into regular memory.
+* Returns NULL when the file can't be mapped, isn't a valid image of this version
+* or its hashfunc id isn't registered. Release with `hm_destroy`.
+*/
+hashmap_t *hm_open_mmap(const char *const path, const hm_map_flags_t flags);
+
+#endif/*_HM_MMAP_H_*/
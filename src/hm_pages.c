@@ -0,0 +1,195 @@
+#include "hm_internal.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#   include <sys/mman.h>
+#   include <unistd.h>
+#endif
+
+#ifdef __linux__
+#   include <sys/syscall.h>
+#endif
+
+#define HUGE_PAGE_SIZE (2u << 20)
+#define MPOL_BIND_MODE 2           /* MPOL_BIND of linux/mempolicy.h */
+#define MPOL_INTERLEAVE_MODE 3     /* MPOL_INTERLEAVE of linux/mempolicy.h */
+#define MPOL_F_MEMS_ALLOWED_FLAG 4 /* MPOL_F_MEMS_ALLOWED of linux/mempolicy.h */
+
+typedef struct fill_task
+{
+    pthread_t thread;
+    char *dst;
+    int byte;
+    size_t size;
+    bool started;
+}
+fill_task_t;
+
+/***                          ***
+* === forward declarations  === *
+***                          ***/
+
+#ifndef _WIN32
+static void *map_pages(const size_t size, const hm_pages_t pages);
+static void apply_numa(void *const mapping, const size_t size, const hm_numa_t numa, const unsigned long nodes);
+#endif
+static void *fill_range(void *const arg);
+
+/***                       ***
+* === API implementation === *
+***                       ***/
+
+void *hm_pages_map_(const hm_opts_t *const opts, size_t *const size)
+{
+    assert(opts);
+    assert(size);
+
+#ifdef _WIN32
+    (void) opts;
+    (void) size;
+    return NULL;
+#else
+    *size = (*size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+    void *mapping = map_pages(*size, opts->pages);
+    if (!mapping) return NULL;
+
+    apply_numa(mapping, *size, opts->numa, opts->numa_nodes);
+    return mapping;
+#endif
+}
+
+
+void hm_pages_unmap_(void *const mapping, const size_t size)
+{
+    assert(mapping);
+
+#ifdef _WIN32
+    (void) mapping;
+    (void) size;
+#else
+    munmap(mapping, size);
+#endif
+}
+
+
+void hm_pages_fill_(void *const dst, const int byte, const size_t size, const size_t nthreads)
+{
+    assert(dst);
+
+    const size_t parts = (nthreads > 1 && size >= nthreads * HUGE_PAGE_SIZE) ? nthreads : 1;
+    fill_task_t *tasks = (parts > 1) ? malloc(parts * sizeof(fill_task_t)) : NULL;
+
+    if (!tasks)
+    {
+        memset(dst, byte, size);
+        return;
+    }
+
+    /* ranges start at huge page boundaries, so no page is shared between threads */
+    const size_t range = (size / parts + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+    for (size_t i = 0; i < parts; ++i)
+    {
+        const size_t begin = (i * range < size) ? i * range : size;
+        const size_t end = (begin + range < size) ? begin + range : size;
+
+        tasks[i] = (fill_task_t){
+            .dst = (char*)dst + begin,
+            .byte = byte,
+            .size = end - begin,
+        };
+    }
+
+    for (size_t i = 1; i < parts; ++i)
+    {
+        tasks[i].started = (0 == pthread_create(&tasks[i].thread, NULL, fill_range, &tasks[i]));
+    }
+
+    fill_range(&tasks[0]);
+
+    for (size_t i = 1; i < parts; ++i)
+    {
+        if (tasks[i].started) pthread_join(tasks[i].thread, NULL);
+        else fill_range(&tasks[i]);
+    }
+
+    free(tasks);
+}
+
+/***                     ***
+* === static functions === *
+***                     ***/
+
+#ifndef _WIN32
+/*
+* Explicit huge pages fail without reserved ones, transparent huge pages are advised then.
+*/
+static void *map_pages(const size_t size, const hm_pages_t pages)
+{
+    void *mapping = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    if (HM_PAGES_HUGETLB == pages)
+    {
+        mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+
+    if (MAP_FAILED == mapping)
+    {
+        mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == mapping) return NULL;
+
+#ifdef MADV_HUGEPAGE
+        if (HM_PAGES_DEFAULT != pages)
+        {
+            (void) madvise(mapping, size, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+    return mapping;
+}
+
+
+/*
+* Sets memory policy of the mapping before its pages are touched.
+* Kernels without NUMA support reject the call, pages are placed by first touch then.
+*/
+static void apply_numa(void *const mapping, const size_t size, const hm_numa_t numa, const unsigned long nodes)
+{
+#ifdef SYS_mbind
+    if (HM_NUMA_DEFAULT == numa) return;
+
+    /* kernel takes one bit less than `maxnode` */
+    const unsigned long maxnode = sizeof(unsigned long) * 8 + 1;
+    const int mode = (HM_NUMA_BIND == numa) ? MPOL_BIND_MODE : MPOL_INTERLEAVE_MODE;
+    unsigned long mask = nodes;
+
+    /* all nodes the process may allocate from */
+    if (!mask && 0 != syscall(SYS_get_mempolicy, NULL, &mask, maxnode, NULL, MPOL_F_MEMS_ALLOWED_FLAG))
+    {
+        return;
+    }
+
+    (void) syscall(SYS_mbind, mapping, size, mode, &mask, maxnode, 0);
+#else
+    (void) mapping;
+    (void) size;
+    (void) numa;
+    (void) nodes;
+#endif
+}
+#endif
+
+
+static void *fill_range(void *const arg)
+{
+    const fill_task_t *task = arg;
+    memset(task->dst, task->byte, task->size);
+    return NULL;
+}
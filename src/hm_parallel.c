@@ -0,0 +1,618 @@
+#include "hm_parallel.h"
+#include "hm_internal.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CACHE_LINE 64
+#define CHUNK_SLOTS 1024 /* 16 cache lines of control bytes */
+
+/*
+* Traversal shared by the workers, chunks of the map and then of its old table
+* are numbered one after another and taken by workers as they get free.
+*/
+typedef struct job
+{
+    const hashmap_t *tables[2];
+    size_t chunks[2];
+    size_t total;
+    _Atomic size_t next; /* next chunk to visit */
+    atomic_int status;   /* first non zero status returned by a callback */
+
+    hm_aggregate_t aggregate;
+    hm_transform_t transform;
+    void *param;
+}
+job_t;
+
+typedef struct worker
+{
+    pthread_t thread;
+    job_t *job;
+    void *acc;
+}
+worker_t;
+
+/*
+* Partitioned placement: source items are split among threads evenly,
+* destination slots are split into ranges, one per thread.
+* Entries get grouped by the range their home slot falls into,
+* then each thread places entries of its range probing within that range only.
+* Probe chains running past the end of a range are finished by a single thread.
+*/
+typedef struct entry
+{
+    size_t index; /* slot of the source table or position in the source arrays */
+    hash_t hash;
+}
+entry_t;
+
+typedef enum
+{
+    PLACED,
+    DUPLICATE,
+    OVERFLOW
+}
+place_result_t;
+
+typedef struct placement
+{
+    hashmap_t *dst;
+    const hashmap_t *src; /* source table, NULL - packed arrays */
+    const char *keys;
+    const char *values;
+    size_t items;  /* source slots or length of the arrays */
+    size_t parts;  /* threads and destination ranges */
+    size_t range;  /* destination slots per range */
+
+    size_t *counts;   /* entries per source thread and range, turned into offsets */
+    size_t *begins;   /* first entry of each range, `parts + 1` of them */
+    size_t *overflow; /* entries of each range left for sequential placement */
+    size_t *placed;   /* entries placed by each thread */
+    entry_t *entries;
+    struct task *tasks;
+}
+placement_t;
+
+typedef struct task
+{
+    pthread_t thread;
+    bool started;
+    void (*func) (placement_t *const, const size_t);
+    placement_t *placement;
+    size_t id;
+}
+task_t;
+
+/***                          ***
+* === forward declarations  === *
+***                          ***/
+
+static void init_job(job_t *const job, const hashmap_t *const map, void *const param);
+static size_t calc_threads(const job_t *const job, size_t nthreads);
+static int run(job_t *const job, const size_t nthreads, char *const accs, const size_t stride);
+static void *work(void *const arg);
+static int visit_chunk(const job_t *const job, const hashmap_t *const table, const size_t chunk, void *const acc);
+
+static hm_status_t place_parallel(placement_t *const pl, const size_t entries, const size_t nthreads);
+static void parallel_for(placement_t *const pl, void (*func) (placement_t *const, const size_t));
+static void *run_task(void *const arg);
+static void count_entries(placement_t *const pl, const size_t part);
+static void scatter_entries(placement_t *const pl, const size_t part);
+static void place_range(placement_t *const pl, const size_t part);
+static bool source_item(const placement_t *const pl, const size_t index, hash_t *const hash);
+static size_t home_range(const placement_t *const pl, const hash_t hash);
+static place_result_t place_entry(placement_t *const pl, const entry_t *const entry, const size_t end, const bool wrap);
+
+/***                       ***
+* === API implementation === *
+***                       ***/
+
+int hm_parallel_aggregate(const hashmap_t *const map,
+        const size_t nthreads,
+        const hm_aggregate_t func,
+        const hm_combine_t combine,
+        void *const acc,
+        const size_t acc_size,
+        void *const param)
+{
+    assert(map);
+    assert(func);
+    assert(combine);
+    assert(acc);
+    assert(acc_size);
+
+    job_t job;
+    init_job(&job, map, param);
+    job.aggregate = func;
+
+    const size_t threads = calc_threads(&job, nthreads);
+
+    /* accumulators of neighbour threads don't share a cache line */
+    const size_t stride = (acc_size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    char *accs = aligned_alloc(CACHE_LINE, stride * threads);
+    if (!accs) return (int)VECTOR_ALLOC_ERROR;
+
+    for (size_t i = 0; i < threads; ++i)
+    {
+        memcpy(accs + i * stride, acc, acc_size);
+    }
+
+    const int status = run(&job, threads, accs, stride);
+
+    if (HM_SUCCESS == status)
+    {
+        for (size_t i = 0; i < threads; ++i)
+        {
+            combine(acc, accs + i * stride, param);
+        }
+    }
+
+    free(accs);
+    return status;
+}
+
+
+int hm_parallel_transform(hashmap_t *const map,
+        const size_t nthreads,
+        const hm_transform_t func,
+        void *const param)
+{
+    assert(map);
+    assert(func);
+
+    /* threads must not preserve chunks for snapshots concurrently */
+    for (const hashmap_t *table = map; table; )
+    {
+        const hm_header_t *header = vector_get_ext_header(table);
+        hm_snapshot_preserve_all_(header);
+        table = header->old;
+    }
+
+    job_t job;
+    init_job(&job, map, param);
+    job.transform = func;
+
+    return run(&job, calc_threads(&job, nthreads), NULL, 0);
+}
+
+
+hm_status_t hm_place_all_parallel_(hashmap_t *const dst, const hashmap_t *const src, const size_t nthreads)
+{
+    assert(dst);
+    assert(src);
+    assert(!((const hm_header_t*)vector_get_ext_header(src))->old);
+
+    placement_t pl = {
+        .dst = dst,
+        .src = src,
+        .items = hm_capacity(src),
+    };
+
+    return place_parallel(&pl, hm_count(src), nthreads);
+}
+
+
+hm_status_t hm_place_many_parallel_(hashmap_t *const dst,
+        const void *const keys, const void *const values, const size_t n, const size_t nthreads)
+{
+    assert(dst);
+    assert(keys && values);
+
+    placement_t pl = {
+        .dst = dst,
+        .keys = keys,
+        .values = values,
+        .items = n,
+    };
+
+    return place_parallel(&pl, n, nthreads);
+}
+
+/***                     ***
+* === static functions === *
+***                     ***/
+
+static void init_job(job_t *const job, const hashmap_t *const map, void *const param)
+{
+    const hm_header_t *header = vector_get_ext_header(map);
+
+    *job = (job_t){
+        .tables = {map, header->old},
+        .param = param,
+    };
+
+    for (size_t t = 0; t < 2 && job->tables[t]; ++t)
+    {
+        job->chunks[t] = (hm_capacity(job->tables[t]) + CHUNK_SLOTS - 1) / CHUNK_SLOTS;
+        job->total += job->chunks[t];
+    }
+
+    atomic_init(&job->next, 0);
+    atomic_init(&job->status, HM_SUCCESS);
+}
+
+
+/*
+* Defaults to amount of online CPUs, there is no use in more threads than chunks.
+*/
+static size_t calc_threads(const job_t *const job, size_t nthreads)
+{
+    if (!nthreads)
+    {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = (cpus > 0) ? (size_t)cpus : 1;
+    }
+
+    return (nthreads < job->total) ? nthreads : job->total ? job->total : 1;
+}
+
+
+/*
+* Caller thread works as the first worker. Chunks are taken dynamically,
+* so the job gets done even if some threads fail to start.
+*/
+static int run(job_t *const job, const size_t nthreads, char *const accs, const size_t stride)
+{
+    worker_t *workers = malloc(nthreads * sizeof(worker_t));
+    if (!workers) return (int)VECTOR_ALLOC_ERROR;
+
+    size_t started = 1;
+
+    for (size_t i = 0; i < nthreads; ++i)
+    {
+        workers[i] = (worker_t){
+            .job = job,
+            .acc = accs ? accs + i * stride : NULL,
+        };
+    }
+
+    for (size_t i = 1; i < nthreads; ++i, ++started)
+    {
+        if (pthread_create(&workers[i].thread, NULL, work, &workers[i])) break;
+    }
+
+    (void) work(&workers[0]);
+
+    for (size_t i = 1; i < started; ++i)
+    {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    free(workers);
+    return atomic_load(&job->status);
+}
+
+
+static void *work(void *const arg)
+{
+    const worker_t *worker = arg;
+    job_t *job = worker->job;
+
+    for (;;)
+    {
+        if (HM_SUCCESS != atomic_load_explicit(&job->status, memory_order_relaxed)) break;
+
+        size_t chunk = atomic_fetch_add_explicit(&job->next, 1, memory_order_relaxed);
+        if (chunk >= job->total) break;
+
+        const hashmap_t *table = job->tables[0];
+        if (chunk >= job->chunks[0])
+        {
+            chunk -= job->chunks[0];
+            table = job->tables[1];
+        }
+
+        const int status = visit_chunk(job, table, chunk, worker->acc);
+        if (HM_SUCCESS != status)
+        {
+            int expected = HM_SUCCESS;
+            atomic_compare_exchange_strong(&job->status, &expected, status);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+
+/*
+* Walks used slots of the chunk by 64 control bytes at a time.
+*/
+static int visit_chunk(const job_t *const job, const hashmap_t *const table, const size_t chunk, void *const acc)
+{
+    const hm_header_t *header = vector_get_ext_header(table);
+    const size_t capacity = hm_capacity(table);
+    const size_t begin = chunk * CHUNK_SLOTS;
+    const size_t end = (begin + CHUNK_SLOTS < capacity) ? begin + CHUNK_SLOTS : capacity;
+
+    for (size_t base = begin; base < end; base += 64)
+    {
+        uint64_t used = 0;
+
+        if (base + 64 <= capacity)
+        {
+            used = ctrl_match_full64(header->ctrl + base);
+        }
+        else
+        {
+            for (size_t i = base; i < capacity; ++i)
+            {
+                used |= (uint64_t)ctrl_is_full(header->ctrl[i]) << (i - base);
+            }
+        }
+
+        for (; used; used &= used - 1)
+        {
+            char *key = header->slots + (base + __builtin_ctzll(used)) * header->slot_size;
+            void *value = key + header->aligned_key_size;
+
+            const int status = job->aggregate
+                ? job->aggregate(key, value, acc, job->param)
+                : job->transform(key, value, job->param);
+
+            if (status) return status;
+        }
+    }
+
+    return HM_SUCCESS;
+}
+
+
+static hm_status_t place_parallel(placement_t *const pl, const size_t entries, const size_t nthreads)
+{
+    hm_header_t *header = vector_get_ext_header(pl->dst);
+    const size_t capacity = hm_capacity(pl->dst);
+    assert(HM_PROBING_LINEAR == header->probing);
+    assert(0 == header->used);
+
+    /* ranges are whole cache lines of control bytes, the first one holds the first group */
+    pl->parts = (nthreads < capacity / CACHE_LINE) ? nthreads : capacity / CACHE_LINE;
+    if (!pl->parts) pl->parts = 1;
+    pl->range = (capacity / pl->parts + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    pl->parts = (capacity + pl->range - 1) / pl->range;
+
+    const size_t parts = pl->parts;
+    pl->counts = calloc(parts * parts, sizeof(size_t));
+    pl->begins = malloc((3 * parts + 1) * sizeof(size_t));
+    pl->entries = malloc(entries * sizeof(entry_t));
+    pl->tasks = malloc(parts * sizeof(task_t));
+
+    if (!pl->counts || !pl->begins || !pl->entries || !pl->tasks)
+    {
+        free(pl->counts);
+        free(pl->begins);
+        free(pl->entries);
+        free(pl->tasks);
+        return (hm_status_t)VECTOR_ALLOC_ERROR;
+    }
+
+    pl->overflow = pl->begins + parts + 1;
+    pl->placed = pl->overflow + parts;
+
+    parallel_for(pl, count_entries);
+
+    /* entries of a range are ordered by source thread, so sources keep their order */
+    size_t offset = 0;
+    for (size_t part = 0; part < parts; ++part)
+    {
+        pl->begins[part] = offset;
+        for (size_t t = 0; t < parts; ++t)
+        {
+            const size_t count = pl->counts[t * parts + part];
+            pl->counts[t * parts + part] = offset;
+            offset += count;
+        }
+    }
+    pl->begins[parts] = offset;
+
+    parallel_for(pl, scatter_entries);
+    parallel_for(pl, place_range);
+
+    for (size_t part = 0; part < parts; ++part)
+    {
+        header->used += pl->placed[part];
+
+        for (size_t i = pl->begins[part]; i < pl->begins[part] + pl->overflow[part]; ++i)
+        {
+            if (PLACED == place_entry(pl, &pl->entries[i], capacity, true)) ++header->used;
+        }
+    }
+
+    free(pl->counts);
+    free(pl->begins);
+    free(pl->entries);
+    free(pl->tasks);
+    return HM_SUCCESS;
+}
+
+
+/*
+* Runs `func` for each part, the caller takes the first one.
+* Parts of threads failed to start are run by the caller as well.
+*/
+static void parallel_for(placement_t *const pl, void (*func) (placement_t *const, const size_t))
+{
+    task_t *tasks = pl->tasks;
+
+    for (size_t i = 1; i < pl->parts; ++i)
+    {
+        tasks[i] = (task_t){ .func = func, .placement = pl, .id = i };
+        tasks[i].started = (0 == pthread_create(&tasks[i].thread, NULL, run_task, &tasks[i]));
+    }
+
+    func(pl, 0);
+
+    for (size_t i = 1; i < pl->parts; ++i)
+    {
+        if (tasks[i].started) pthread_join(tasks[i].thread, NULL);
+        else func(pl, i);
+    }
+}
+
+
+static void *run_task(void *const arg)
+{
+    const task_t *task = arg;
+    task->func(task->placement, task->id);
+    return NULL;
+}
+
+
+static void count_entries(placement_t *const pl, const size_t part)
+{
+    const size_t begin = pl->items * part / pl->parts;
+    const size_t end = pl->items * (part + 1) / pl->parts;
+    size_t *counts = pl->counts + part * pl->parts;
+    hash_t hash;
+
+    for (size_t i = begin; i < end; ++i)
+    {
+        if (source_item(pl, i, &hash)) ++counts[home_range(pl, hash)];
+    }
+}
+
+
+/*
+* Second pass over the same items, hash codes are computed again
+* rather than kept for every source slot.
+*/
+static void scatter_entries(placement_t *const pl, const size_t part)
+{
+    const size_t begin = pl->items * part / pl->parts;
+    const size_t end = pl->items * (part + 1) / pl->parts;
+    size_t *offsets = pl->counts + part * pl->parts;
+    hash_t hash;
+
+    for (size_t i = begin; i < end; ++i)
+    {
+        if (source_item(pl, i, &hash))
+        {
+            pl->entries[offsets[home_range(pl, hash)]++] = (entry_t){ .index = i, .hash = hash };
+        }
+    }
+}
+
+
+/*
+* Entries that didn't fit in the range are moved to its beginning.
+*/
+static void place_range(placement_t *const pl, const size_t part)
+{
+    const size_t capacity = hm_capacity(pl->dst);
+    const size_t end = ((part + 1) * pl->range < capacity) ? (part + 1) * pl->range : capacity;
+    size_t placed = 0;
+    size_t kept = pl->begins[part];
+
+    for (size_t i = pl->begins[part]; i < pl->begins[part + 1]; ++i)
+    {
+        switch (place_entry(pl, &pl->entries[i], end, false))
+        {
+            case PLACED: ++placed; break;
+            case DUPLICATE: break;
+            case OVERFLOW: pl->entries[kept++] = pl->entries[i]; break;
+        }
+    }
+
+    pl->placed[part] = placed;
+    pl->overflow[part] = kept - pl->begins[part];
+}
+
+
+/*
+* Returns false for empty slots of the source table.
+*/
+static bool source_item(const placement_t *const pl, const size_t index, hash_t *const hash)
+{
+    const hm_header_t *header = vector_get_ext_header(pl->dst);
+
+    if (!pl->src)
+    {
+        *hash = hm_hash_bytes(header, pl->keys + index * header->key_size, header->key_size);
+        return true;
+    }
+
+    const hm_header_t *src_header = vector_get_ext_header(pl->src);
+    if (!ctrl_is_full(src_header->ctrl[index])) return false;
+
+    const char *slot = src_header->slots + index * src_header->slot_size;
+
+    if (src_header->hash_offset)
+    {
+        memcpy(hash, slot + src_header->hash_offset, sizeof(hash_t));
+    }
+    else if (src_header->var_keys)
+    {
+        const hm_key_t *key = (const hm_key_t*)slot;
+        *hash = hm_hash_bytes(src_header, key->data, key->size);
+    }
+    else
+    {
+        *hash = hm_hash_bytes(src_header, slot, src_header->key_size);
+    }
+    return true;
+}
+
+
+static size_t home_range(const placement_t *const pl, const hash_t hash)
+{
+    const hm_header_t *header = vector_get_ext_header(pl->dst);
+    const size_t capacity = hm_capacity(pl->dst);
+
+    return hm_hash_to_index(header, hm_mix_hash(header, hash), capacity) / pl->range;
+}
+
+
+/*
+* Takes the first empty slot from home of the entry, like group probing does
+* in a table without tombstones. Without `wrap` probing stops at `end`.
+*/
+static place_result_t place_entry(placement_t *const pl, const entry_t *const entry, const size_t end, const bool wrap)
+{
+    hm_header_t *header = vector_get_ext_header(pl->dst);
+    const size_t capacity = hm_capacity(pl->dst);
+    const uint64_t mixed = hm_mix_hash(header, entry->hash);
+    const ctrl_t h2 = hm_hash_to_fragment(mixed);
+
+    const char *source = pl->src
+        ? ((const hm_header_t*)vector_get_ext_header(pl->src))->slots + entry->index * header->slot_size
+        : pl->keys + entry->index * header->key_size;
+
+    for (size_t index = hm_hash_to_index(header, mixed, capacity); ; )
+    {
+        char *slot = header->slots + index * header->slot_size;
+
+        if (HM_CTRL_EMPTY == header->ctrl[index])
+        {
+            header->ctrl[index] = h2;
+            if (index < HM_GROUP_WIDTH) header->ctrl[capacity + index] = h2;
+
+            if (pl->src)
+            {
+                memcpy(slot, source, header->slot_size);
+            }
+            else
+            {
+                memcpy(slot, source, header->key_size);
+                memcpy(slot + header->aligned_key_size,
+                        pl->values + entry->index * header->value_size, header->value_size);
+                if (header->hash_offset) memcpy(slot + header->hash_offset, &entry->hash, sizeof(hash_t));
+            }
+            return PLACED;
+        }
+
+        if (!pl->src && h2 == header->ctrl[index] && 0 == memcmp(slot, source, header->key_size))
+        {
+            return DUPLICATE;
+        }
+
+        if (++index == end)
+        {
+            if (!wrap) return OVERFLOW;
+            index = 0;
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef _HM_PARALLEL_H_
+#define _HM_PARALLEL_H_
+
+/*
+* Multithreaded traversal of a hashmap.
+* Slots are handed out to threads in chunks of whole control byte cache lines,
+* callbacks are invoked concurrently and in no particular order.
+*/
+
+#include "hashmap.h"
+
+/*
+* Merges accumulator `other` of a worker thread into `acc`.
+*/
+typedef void (*hm_combine_t) (void *const acc, const void *const other, void *const param);
+
+
+/*
+* Parallel `hm_aggregate`, each thread folds its slots into a private copy of `acc`,
+* copies are merged into `acc` with `combine` once all threads are done.
+* Initial value of `acc` gets into every copy, so it must be neutral for `combine` (e.g. 0 for sums).
+* `nthreads` of 0 uses all online CPUs. Stops at the first non zero status returned by `func`
+* and returns it, `acc` is left untouched then.
+*/
+int hm_parallel_aggregate(const hashmap_t *const map,
+        const size_t nthreads,
+        const hm_aggregate_t func,
+        const hm_combine_t combine,
+        void *const acc,
+        const size_t acc_size,
+        void *const param);
+
+
+/*
+* Parallel `hm_transform`, `func` must be safe to call concurrently for distinct mappings.
+*/
+int hm_parallel_transform(hashmap_t *const map,
+        const size_t nthreads,
+        const hm_transform_t func,
+        void *const param);
+
+#endif/*_HM_PARALLEL_H_*/
@@ -0,0 +1,74 @@
+#include "hm_pool.h"
+#include <assert.h>
+#include <stdlib.h>
+
+struct hm_pool
+{
+    hm_opts_t opts;
+    size_t max_idle;
+    size_t idle;
+    hashmap_t *maps[];
+};
+
+/***                       ***
+* === API implementation === *
+***                       ***/
+
+hm_pool_t *hm_pool_create_(const size_t max_idle, const hm_opts_t *const opts)
+{
+    assert(opts);
+
+    hm_pool_t *pool = malloc(sizeof(hm_pool_t) + max_idle * sizeof(hashmap_t*));
+    if (!pool) return NULL;
+
+    pool->opts = *opts;
+    pool->max_idle = max_idle;
+    pool->idle = 0;
+
+    return pool;
+}
+
+
+void hm_pool_destroy(hm_pool_t *const pool)
+{
+    assert(pool);
+
+    for (size_t i = 0; i < pool->idle; ++i)
+    {
+        hm_destroy(pool->maps[i]);
+    }
+    free(pool);
+}
+
+
+hashmap_t *hm_pool_acquire(hm_pool_t *const pool)
+{
+    assert(pool);
+
+    if (pool->idle) return pool->maps[--pool->idle];
+
+    return hm_create_(&pool->opts);
+}
+
+
+void hm_pool_release(hm_pool_t *const pool, hashmap_t *const map)
+{
+    assert(pool);
+    assert(map);
+
+    if (pool->idle == pool->max_idle)
+    {
+        hm_destroy(map);
+        return;
+    }
+
+    hm_clear(map);
+    pool->maps[pool->idle++] = map;
+}
+
+
+size_t hm_pool_idle(const hm_pool_t *const pool)
+{
+    assert(pool);
+    return pool->idle;
+}
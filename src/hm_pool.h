@@ -0,0 +1,57 @@
+#ifndef _HM_POOL_H_
+#define _HM_POOL_H_
+
+/*
+* Pool of recycled hashmaps for short lived maps of the same options.
+*
+* Released maps are cleared with `hm_clear` and kept with their storage (grown capacity included),
+* acquiring one takes no allocation while the pool has idle maps.
+* Slots for idle maps are allocated once, when the pool is created.
+* Pool is not synchronized, use one per thread.
+*/
+
+#include "hashmap.h"
+
+typedef struct hm_pool hm_pool_t;
+
+
+/*
+* The wrapper for `hm_pool_create_` function that provides default values.
+*/
+#define hm_pool_create(max_idle, ...) \
+    hm_pool_create_(max_idle, &(hm_opts_t){ \
+        .capacity = 256, \
+        .max_load_factor = HM_DEFAULT_MAX_LOAD_FACTOR, \
+        __VA_ARGS__ \
+    })
+
+/*
+* Creates pool keeping up to `max_idle` released maps created with `opts`.
+*/
+hm_pool_t *hm_pool_create_(const size_t max_idle, const hm_opts_t *const opts);
+
+
+/*
+* Destroys the pool with its idle maps, acquired maps stay valid and are destroyed by the caller.
+*/
+void hm_pool_destroy(hm_pool_t *const pool);
+
+
+/*
+* Takes an empty map, an idle one when available. Returns NULL on allocation failure.
+*/
+hashmap_t *hm_pool_acquire(hm_pool_t *const pool);
+
+
+/*
+* Returns the map acquired from the pool, the map is destroyed when the pool is full.
+*/
+void hm_pool_release(hm_pool_t *const pool, hashmap_t *const map);
+
+
+/*
+* Amount of idle maps.
+*/
+size_t hm_pool_idle(const hm_pool_t *const pool);
+
+#endif/*_HM_POOL_H_*/
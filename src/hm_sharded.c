@@ -0,0 +1,268 @@
+#include "hm_sharded.h"
+#include "hm_internal.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_LINE 64
+
+/*
+* Shards are cache line aligned, so locks of neighbour shards don't share a line.
+*/
+typedef struct hm_shard
+{
+    _Alignas(CACHE_LINE) pthread_mutex_t lock;
+    hashmap_t *map;
+}
+hm_shard_t;
+
+struct hm_sharded
+{
+    unsigned int shift; /* 64 - log2(amount of shards) */
+    size_t shards;
+    hashfunc_t hashfunc; /* keys are hashed before any shard is locked */
+    uint64_t seed;       /* built-in kernel seed shared by all shards */
+    size_t key_size;
+    size_t value_size;
+    bool var_keys;
+    hm_shard_t shard[];
+};
+
+/***                          ***
+* === forward declarations  === *
+***                          ***/
+
+static hash_t key_hash(const hm_sharded_t *const map, const void *const key);
+static hm_shard_t *get_shard(hm_sharded_t *const map, const hash_t hash);
+
+/***                       ***
+* === API implementation === *
+***                       ***/
+
+hm_sharded_t *hm_sharded_create_(const hm_opts_t *const opts, const size_t shards)
+{
+    assert(opts);
+    assert(shards);
+
+    const unsigned int bits = (shards > 1) ? 64 - __builtin_clzll(shards - 1) : 0;
+    const size_t count = (size_t)1 << bits;
+    const size_t size = sizeof(hm_sharded_t) + count * sizeof(hm_shard_t);
+
+    hm_sharded_t *map = aligned_alloc(CACHE_LINE, (size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE);
+    if (!map) return NULL;
+
+    map->shift = 64 - bits;
+    map->shards = count;
+    map->hashfunc = opts->hashfunc;
+    map->seed = opts->seed;
+    map->key_size = opts->key_size;
+    map->value_size = opts->value_size;
+    map->var_keys = opts->var_keys;
+
+    hm_opts_t shard_opts = *opts;
+    shard_opts.capacity = opts->capacity / count;
+
+    /* shards hash keys the same way, so the map can hash them before picking one */
+    if (!opts->hashfunc && !opts->seed)
+    {
+        hm_random_(&map->seed, sizeof(map->seed));
+        map->seed |= 1;
+        shard_opts.seed = map->seed;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        map->shard[i].map = hm_create_(&shard_opts);
+        if (!map->shard[i].map || pthread_mutex_init(&map->shard[i].lock, NULL))
+        {
+            if (map->shard[i].map) hm_destroy(map->shard[i].map);
+            map->shards = i;
+            hm_sharded_destroy(map);
+            return NULL;
+        }
+    }
+
+    return map;
+}
+
+
+void hm_sharded_destroy(hm_sharded_t *const map)
+{
+    assert(map);
+
+    for (size_t i = 0; i < map->shards; ++i)
+    {
+        pthread_mutex_destroy(&map->shard[i].lock);
+        hm_destroy(map->shard[i].map);
+    }
+    free(map);
+}
+
+
+hm_status_t hm_sharded_insert(hm_sharded_t *const map, const void *const key, const void *const value)
+{
+    assert(map);
+    assert(key);
+    assert(value);
+
+    const hash_t hash = key_hash(map, key);
+    hm_shard_t *shard = get_shard(map, hash);
+
+    pthread_mutex_lock(&shard->lock);
+
+    void *stored_value;
+    const hm_status_t status = hm_reserve_hashed_(&shard->map, key, hash, &stored_value);
+    if (HM_SUCCESS == status)
+    {
+        memcpy(stored_value, value, map->value_size);
+    }
+
+    pthread_mutex_unlock(&shard->lock);
+    return status;
+}
+
+
+hm_status_t hm_sharded_upsert(hm_sharded_t *const map, const void *const key, const void *const value)
+{
+    assert(map);
+    assert(key);
+    assert(value);
+
+    const hash_t hash = key_hash(map, key);
+    hm_shard_t *shard = get_shard(map, hash);
+
+    pthread_mutex_lock(&shard->lock);
+
+    void *stored_value;
+    hm_status_t status = hm_reserve_hashed_(&shard->map, key, hash, &stored_value);
+    if (HM_SUCCESS == status || HM_ALREADY_EXISTS == status)
+    {
+        memcpy(stored_value, value, map->value_size);
+        status = HM_SUCCESS;
+    }
+
+    pthread_mutex_unlock(&shard->lock);
+    return status;
+}
+
+
+bool hm_sharded_update(hm_sharded_t *const map, const void *const key, const void *const value)
+{
+    assert(map);
+    assert(key);
+    assert(value);
+
+    const hash_t hash = key_hash(map, key);
+    hm_shard_t *shard = get_shard(map, hash);
+
+    pthread_mutex_lock(&shard->lock);
+
+    void *stored_value = hm_get_hashed_(shard->map, key, hash);
+    if (stored_value)
+    {
+        memcpy(stored_value, value, map->value_size);
+    }
+
+    pthread_mutex_unlock(&shard->lock);
+    return NULL != stored_value;
+}
+
+
+void hm_sharded_remove(hm_sharded_t *const map, const void *const key)
+{
+    assert(map);
+    assert(key);
+
+    const hash_t hash = key_hash(map, key);
+    hm_shard_t *shard = get_shard(map, hash);
+
+    pthread_mutex_lock(&shard->lock);
+    hm_remove_hashed_(shard->map, key, hash);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+
+bool hm_sharded_get(hm_sharded_t *const map, const void *const key, void *const value_out)
+{
+    assert(map);
+    assert(key);
+
+    const hash_t hash = key_hash(map, key);
+    hm_shard_t *shard = get_shard(map, hash);
+
+    pthread_mutex_lock(&shard->lock);
+
+    const void *stored_value = hm_get_hashed_(shard->map, key, hash);
+    if (stored_value && value_out)
+    {
+        memcpy(value_out, stored_value, map->value_size);
+    }
+
+    pthread_mutex_unlock(&shard->lock);
+    return NULL != stored_value;
+}
+
+
+size_t hm_sharded_count(hm_sharded_t *const map)
+{
+    assert(map);
+
+    size_t count = 0;
+
+    for (size_t i = 0; i < map->shards; ++i)
+    {
+        pthread_mutex_lock(&map->shard[i].lock);
+        count += hm_count(map->shard[i].map);
+        pthread_mutex_unlock(&map->shard[i].lock);
+    }
+
+    return count;
+}
+
+
+int hm_sharded_foreach(hm_sharded_t *const map, const hm_foreach_t func, void *const param)
+{
+    assert(map);
+    assert(func);
+
+    for (size_t i = 0; i < map->shards; ++i)
+    {
+        pthread_mutex_lock(&map->shard[i].lock);
+        const int status = hm_foreach(map->shard[i].map, func, param);
+        pthread_mutex_unlock(&map->shard[i].lock);
+
+        if (status) return status;
+    }
+
+    return HM_SUCCESS;
+}
+
+/***                     ***
+* === static functions === *
+***                     ***/
+
+/*
+* Same hash code shards compute for the key, @see hm_get_hashed_.
+*/
+static hash_t key_hash(const hm_sharded_t *const map, const void *const key)
+{
+    if (map->var_keys)
+    {
+        const hm_key_t *var_key = key;
+        return hm_hash_key(map->hashfunc, map->seed, var_key->data, var_key->size);
+    }
+    return hm_hash_key(map->hashfunc, map->seed, key, map->key_size);
+}
+
+
+/*
+* Shard is picked by high bits of fibonacci hashed code,
+* shards mix hash codes with their own random factors, so keys still spread inside of a shard.
+*/
+static hm_shard_t *get_shard(hm_sharded_t *const map, const hash_t hash)
+{
+    if (1 == map->shards) return map->shard;
+
+    return map->shard + (((uint64_t)hash * 0x9e3779b97f4a7c15ull) >> map->shift);
+}
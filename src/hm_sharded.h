@@ -0,0 +1,68 @@
+#ifndef _HM_SHARDED_H_
+#define _HM_SHARDED_H_
+
+/*
+* Hashmap split into independent shards for concurrent use.
+* Shard is selected by high bits of the key's hash code,
+* each shard has its own lock and grows on its own.
+*/
+
+#include "hashmap.h"
+
+typedef struct hm_sharded hm_sharded_t;
+
+
+/*
+* The wrapper for `hm_sharded_create_` function that provides default values.
+* `capacity` is split among the shards.
+*/
+#define hm_sharded_create(shards, ...) \
+    hm_sharded_create_(&(hm_opts_t){ \
+        .capacity = 256, \
+        .max_load_factor = HM_DEFAULT_MAX_LOAD_FACTOR, \
+        __VA_ARGS__ \
+    }, shards)
+
+/*
+* Creates sharded hashmap, amount of shards is rounded up to a power of two.
+*/
+hm_sharded_t *hm_sharded_create_(const hm_opts_t *const opts, const size_t shards);
+
+
+/*
+* Release sharded hashmap resources.
+*/
+void hm_sharded_destroy(hm_sharded_t *const map);
+
+
+/*
+* Thread safe counterparts of the hashmap calls,
+* only the shard owning the key gets locked.
+*/
+hm_status_t hm_sharded_insert(hm_sharded_t *const map, const void *const key, const void *const value);
+hm_status_t hm_sharded_upsert(hm_sharded_t *const map, const void *const key, const void *const value);
+bool hm_sharded_update(hm_sharded_t *const map, const void *const key, const void *const value);
+void hm_sharded_remove(hm_sharded_t *const map, const void *const key);
+
+
+/*
+* Copies the value into `value_out` (optional) while the shard is locked,
+* since stored values may move once the lock is released.
+* Returns false when the key is missing.
+*/
+bool hm_sharded_get(hm_sharded_t *const map, const void *const key, void *const value_out);
+
+
+/*
+* Returns amount of mappings in all shards.
+*/
+size_t hm_sharded_count(hm_sharded_t *const map);
+
+
+/*
+* Visits shards one by one, `func` is called while its shard is locked
+* and must not call back into the same map.
+*/
+int hm_sharded_foreach(hm_sharded_t *const map, const hm_foreach_t func, void *const param);
+
+#endif/*_HM_SHARDED_H_*/
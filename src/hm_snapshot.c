@@ -0,0 +1,275 @@
+#include "hm_snapshot.h"
+#include "hm_internal.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct chunk
+{
+    const ctrl_t *ctrl;
+    const char *slots;
+    char *copy; /* private copy of control bytes and slots, NULL - shared with the table */
+}
+chunk_t;
+
+struct hm_snapshot
+{
+    hm_header_t header;       /* table header as of the snapshot */
+    hashmap_t *table;         /* table the chunks are shared with */
+    struct hm_snapshot *next; /* other snapshots of the same table */
+    bool valid;
+    size_t chunks;
+    chunk_t chunk[];
+};
+
+/***                          ***
+* === forward declarations  === *
+***                          ***/
+
+static void preserve_chunk(hm_snapshot_t *const snapshot, const size_t index);
+static const ctrl_t *load_ctrl(const hm_snapshot_t *const snapshot, const size_t pos, ctrl_t *const buf);
+static const char *get_slot(const hm_snapshot_t *const snapshot, const size_t index);
+static bool slot_matches(const hm_snapshot_t *const snapshot, const char *const slot,
+        const void *const key, const hash_t hash);
+
+/***                       ***
+* === API implementation === *
+***                       ***/
+
+hm_snapshot_t *hm_snapshot(hashmap_t *const map)
+{
+    assert(map);
+
+    hm_header_t *header = vector_get_ext_header(map);
+    assert(!header->var_keys && "maps with variable length keys can't be snapshotted");
+    assert(!header->old && "maps under incremental resize can't be snapshotted");
+
+    const size_t capacity = hm_capacity(map);
+    const size_t chunks = (capacity + HM_SNAPSHOT_CHUNK - 1) / HM_SNAPSHOT_CHUNK;
+
+    hm_snapshot_t *snapshot = malloc(sizeof(hm_snapshot_t) + chunks * sizeof(chunk_t));
+    if (!snapshot) return NULL;
+
+    snapshot->header = *header;
+    snapshot->header.snapshots = NULL;
+    snapshot->table = map;
+    snapshot->valid = true;
+    snapshot->chunks = chunks;
+
+    for (size_t c = 0; c < chunks; ++c)
+    {
+        snapshot->chunk[c] = (chunk_t){
+            .ctrl = header->ctrl + c * HM_SNAPSHOT_CHUNK,
+            .slots = header->slots + c * HM_SNAPSHOT_CHUNK * header->slot_size,
+        };
+    }
+
+    snapshot->next = header->snapshots;
+    header->snapshots = snapshot;
+
+    return snapshot;
+}
+
+
+void hm_snapshot_release(hm_snapshot_t *const snapshot)
+{
+    assert(snapshot);
+
+    hashmap_t *table = snapshot->table;
+    hm_header_t *header = vector_get_ext_header(table);
+
+    for (hm_snapshot_t **link = &header->snapshots; *link; link = &(*link)->next)
+    {
+        if (*link == snapshot)
+        {
+            *link = snapshot->next;
+            break;
+        }
+    }
+
+    for (size_t c = 0; c < snapshot->chunks; ++c)
+    {
+        free(snapshot->chunk[c].copy);
+    }
+    free(snapshot);
+
+    if (header->orphaned && !header->snapshots)
+    {
+        hm_destroy(table);
+    }
+}
+
+
+bool hm_snapshot_valid(const hm_snapshot_t *const snapshot)
+{
+    assert(snapshot);
+    return snapshot->valid;
+}
+
+
+size_t hm_snapshot_count(const hm_snapshot_t *const snapshot)
+{
+    assert(snapshot);
+    return snapshot->header.used;
+}
+
+
+const void *hm_snapshot_get(const hm_snapshot_t *const snapshot, const void *const key)
+{
+    assert(snapshot);
+    assert(key);
+    assert(snapshot->valid);
+
+    const hm_header_t *header = &snapshot->header;
+    const size_t capacity = header->capacity;
+    const hash_t hash = hm_hash_bytes(header, key, header->key_size);
+    const uint64_t mixed = hm_mix_hash(header, hash);
+    const ctrl_t h2 = hm_hash_to_fragment(mixed);
+    size_t pos = hm_hash_to_index(header, mixed, capacity);
+    ctrl_t buf[HM_GROUP_WIDTH];
+
+    /* robin hood tables are probed by groups as well, keys never lie past an empty slot */
+    for (size_t probed = 0; probed < capacity; probed += HM_GROUP_WIDTH)
+    {
+        const hm_group_t group = group_load(load_ctrl(snapshot, pos, buf));
+
+        for (hm_mask_t match = group_match(group, h2); match; match = mask_clear_lowest(match))
+        {
+            const char *slot = get_slot(snapshot, hm_wrap_index(header, pos + mask_lowest(match), capacity));
+            if (slot_matches(snapshot, slot, key, hash))
+            {
+                return slot + header->aligned_key_size;
+            }
+        }
+
+        if (group_match_empty(group)) break;
+
+        pos = hm_wrap_index(header, pos + HM_GROUP_WIDTH, capacity);
+    }
+
+    return NULL;
+}
+
+
+int hm_snapshot_foreach(const hm_snapshot_t *const snapshot,
+        const hm_foreach_t func,
+        void *const param)
+{
+    assert(snapshot);
+    assert(func);
+    assert(snapshot->valid);
+
+    const hm_header_t *header = &snapshot->header;
+
+    for (size_t c = 0; c < snapshot->chunks; ++c)
+    {
+        const chunk_t *chunk = &snapshot->chunk[c];
+        const size_t first = c * HM_SNAPSHOT_CHUNK;
+        const size_t n = (header->capacity - first < HM_SNAPSHOT_CHUNK) ? header->capacity - first : HM_SNAPSHOT_CHUNK;
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (!ctrl_is_full(chunk->ctrl[i])) continue;
+
+            const char *slot = chunk->slots + i * header->slot_size;
+            int status = func(slot, slot + header->aligned_key_size, param);
+            if (status) return status;
+        }
+    }
+
+    return HM_SUCCESS;
+}
+
+
+void hm_snapshot_preserve_(const hm_header_t *const header, const size_t index)
+{
+    for (hm_snapshot_t *snapshot = header->snapshots; snapshot; snapshot = snapshot->next)
+    {
+        if (snapshot->valid && !snapshot->chunk[index / HM_SNAPSHOT_CHUNK].copy)
+        {
+            preserve_chunk(snapshot, index / HM_SNAPSHOT_CHUNK);
+        }
+    }
+}
+
+
+void hm_snapshot_preserve_all_(const hm_header_t *const header)
+{
+    if (!header->snapshots) return;
+
+    for (size_t index = 0; index < header->capacity; index += HM_SNAPSHOT_CHUNK)
+    {
+        hm_snapshot_preserve_(header, index);
+    }
+}
+
+/***                     ***
+* === static functions === *
+***                     ***/
+
+/*
+* Copies the chunk out of the table, snapshot gets invalid when there is no memory for it.
+*/
+static void preserve_chunk(hm_snapshot_t *const snapshot, const size_t index)
+{
+    const hm_header_t *header = &snapshot->header;
+    chunk_t *chunk = &snapshot->chunk[index];
+    const size_t first = index * HM_SNAPSHOT_CHUNK;
+    const size_t n = (header->capacity - first < HM_SNAPSHOT_CHUNK) ? header->capacity - first : HM_SNAPSHOT_CHUNK;
+    const size_t ctrl_size = HM_ALIGNED_SIZE(n);
+
+    chunk->copy = malloc(ctrl_size + n * header->slot_size);
+    if (!chunk->copy)
+    {
+        snapshot->valid = false;
+        return;
+    }
+
+    memcpy(chunk->copy, chunk->ctrl, n);
+    memcpy(chunk->copy + ctrl_size, chunk->slots, n * header->slot_size);
+    chunk->ctrl = (const ctrl_t*)chunk->copy;
+    chunk->slots = chunk->copy + ctrl_size;
+}
+
+
+/*
+* Group of control bytes starting at `pos`, gathered into `buf`
+* when it spans two chunks or wraps around the end of the table.
+*/
+static const ctrl_t *load_ctrl(const hm_snapshot_t *const snapshot, const size_t pos, ctrl_t *const buf)
+{
+    const hm_header_t *header = &snapshot->header;
+    const size_t offset = pos % HM_SNAPSHOT_CHUNK;
+
+    if (offset + HM_GROUP_WIDTH <= HM_SNAPSHOT_CHUNK && pos + HM_GROUP_WIDTH <= header->capacity)
+    {
+        return snapshot->chunk[pos / HM_SNAPSHOT_CHUNK].ctrl + offset;
+    }
+
+    for (size_t i = 0; i < HM_GROUP_WIDTH; ++i)
+    {
+        const size_t index = hm_wrap_index(header, pos + i, header->capacity);
+        buf[i] = snapshot->chunk[index / HM_SNAPSHOT_CHUNK].ctrl[index % HM_SNAPSHOT_CHUNK];
+    }
+    return buf;
+}
+
+
+static const char *get_slot(const hm_snapshot_t *const snapshot, const size_t index)
+{
+    const chunk_t *chunk = &snapshot->chunk[index / HM_SNAPSHOT_CHUNK];
+    return chunk->slots + (index % HM_SNAPSHOT_CHUNK) * snapshot->header.slot_size;
+}
+
+
+static bool slot_matches(const hm_snapshot_t *const snapshot, const char *const slot,
+        const void *const key, const hash_t hash)
+{
+    const hm_header_t *header = &snapshot->header;
+
+    if (header->hash_offset && *(const hash_t*)(slot + header->hash_offset) != hash)
+    {
+        return false;
+    }
+    return 0 == memcmp(key, slot, header->key_size);
+}
@@ -0,0 +1,67 @@
+#ifndef _HM_SNAPSHOT_H_
+#define _HM_SNAPSHOT_H_
+
+/*
+* Copy-on-write snapshots of a hashmap.
+*
+* Snapshot is a read-only view of the map as of the moment it was taken. It shares the table
+* in chunks of `HM_SNAPSHOT_CHUNK` slots with the map, taking one costs a pointer per chunk.
+* Before the map changes a slot, the chunk holding it is copied for snapshots still sharing it,
+* so only chunks the map writes to get duplicated. Table the map moves away from on rehash
+* is kept alive until the last snapshot sharing it is released.
+*
+* While snapshots are taken, values of the map are modified only through the API
+* (`hm_update`, `hm_upsert`, `hm_reserve`, `hm_transform`, ...). Values reached through
+* `hm_get`, iterators and spans are for reading, writes through them would leak into snapshots.
+* Snapshots are not synchronized with the map, reading them concurrently with
+* modifications of the map needs a lock.
+*
+* Maps with variable length keys and maps under incremental resize are not supported.
+*/
+
+#include "hashmap.h"
+
+#define HM_SNAPSHOT_CHUNK 4096 /**< slots per chunk, a multiple of group width */
+
+typedef struct hm_snapshot hm_snapshot_t;
+
+
+/*
+* Takes a snapshot of the map. Returns NULL on allocation failure.
+*/
+hm_snapshot_t *hm_snapshot(hashmap_t *const map);
+
+
+/*
+* Releases the snapshot, along with the table of the map it was taken from
+* when the map has moved to another table or was destroyed.
+*/
+void hm_snapshot_release(hm_snapshot_t *const snapshot);
+
+
+/*
+* False when copying a chunk failed on allocation, the snapshot can't be read then.
+*/
+bool hm_snapshot_valid(const hm_snapshot_t *const snapshot);
+
+
+/*
+* Amount of mappings in the snapshot.
+*/
+size_t hm_snapshot_count(const hm_snapshot_t *const snapshot);
+
+
+/*
+* Value of the key as of the snapshot, NULL if missing.
+*/
+const void *hm_snapshot_get(const hm_snapshot_t *const snapshot, const void *const key);
+
+
+/*
+* Calls `func` for every mapping of the snapshot, stops at the first non zero status and returns it.
+*/
+int hm_snapshot_foreach(const hm_snapshot_t *const snapshot,
+        const hm_foreach_t func,
+        void *const param);
+
+#endif/*_HM_SNAPSHOT_H_*/
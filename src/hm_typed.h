@@ -0,0 +1,116 @@
+#ifndef _HM_TYPED_H_
+#define _HM_TYPED_H_
+
+/*
+* Type specialized hashmap generator.
+*
+* HM_DECLARE(name, K, V, hashfn, eqfn) emits static inline functions working
+* with keys of type `K` and values of type `V` with sizes known at compile time:
+*
+*   hashmap_t *name_create(size_t capacity);
+*   V *name_get(const hashmap_t *map, K key);
+*   bool name_contains(const hashmap_t *map, K key);
+*   hm_status_t name_insert(hashmap_t **map, K key, V value);
+*   hm_status_t name_upsert(hashmap_t **map, K key, V value);
+*   void name_remove(hashmap_t *map, K key);
+*
+* `hash_t hashfn(K key)` and `bool eqfn(K a, K b)` are called directly and can be inlined.
+* Generated maps are regular `hashmap_t` (linear probing, power of two capacity),
+* so `hm_count`, `hm_foreach`, `hm_destroy`, etc. apply to them as well.
+* Lookups walk the candidates of `hm_probe` and compare keys inline, control bytes are
+* matched by the library as it is built, placement of new keys and growth go through the generic code.
+* Generic calls taking keys compare them bytewise, mixing them with generated ones
+* requires `eqfn` to agree with `memcmp`.
+*/
+
+#include "hashmap.h"
+#include <stdbool.h>
+#include <string.h>
+
+#define HM_DECLARE(name, K, V, hashfn, eqfn) \
+\
+static inline hash_t name##_hashfunc_(const void *const key, const size_t size) \
+{ \
+    (void) size; \
+    K k; \
+    memcpy(&k, key, sizeof(K)); \
+    return hashfn(k); \
+} \
+\
+static inline hashmap_t *name##_create(const size_t capacity) \
+{ \
+    return hm_create( \
+        .key_size = sizeof(K), \
+        .value_size = sizeof(V), \
+        .hashfunc = name##_hashfunc_, \
+        .capacity = capacity, \
+    ); \
+} \
+\
+/* advances the probe to the slot holding the key, false when missing */ \
+static inline bool name##_find_(hm_probe_t *const probe, const K key, void **const value) \
+{ \
+    const void *stored_key; \
+\
+    while (hm_probe_next(probe, &stored_key, value)) \
+    { \
+        K stored; \
+        memcpy(&stored, stored_key, sizeof(K)); \
+        if (eqfn(stored, key)) return true; \
+    } \
+    return false; \
+} \
+\
+static inline V *name##_lookup_(const hashmap_t *const map, const K key, const hash_t hash) \
+{ \
+    hm_probe_t probe = hm_probe(map, hash); \
+    void *value; \
+    return name##_find_(&probe, key, &value) ? (V*)value : NULL; \
+} \
+\
+static inline V *name##_get(const hashmap_t *const map, const K key) \
+{ \
+    return name##_lookup_(map, key, hashfn(key)); \
+} \
+\
+static inline bool name##_contains(const hashmap_t *const map, const K key) \
+{ \
+    return NULL != name##_get(map, key); \
+} \
+\
+static inline hm_status_t name##_insert(hashmap_t **const map, const K key, const V value) \
+{ \
+    const hash_t hash = hashfn(key); \
+    if (name##_lookup_(*map, key, hash)) return HM_ALREADY_EXISTS; \
+\
+    void *stored_value; \
+    const hm_status_t status = hm_insert_absent_(map, &key, hash, &stored_value); \
+    if (HM_SUCCESS == status) memcpy(stored_value, &value, sizeof(V)); \
+    return status; \
+} \
+\
+static inline hm_status_t name##_upsert(hashmap_t **const map, const K key, const V value) \
+{ \
+    const hash_t hash = hashfn(key); \
+    V *stored = name##_lookup_(*map, key, hash); \
+    if (stored) \
+    { \
+        hm_touch_value_(*map, stored); \
+        memcpy(stored, &value, sizeof(V)); \
+        return HM_SUCCESS; \
+    } \
+\
+    void *stored_value; \
+    const hm_status_t status = hm_insert_absent_(map, &key, hash, &stored_value); \
+    if (HM_SUCCESS == status) memcpy(stored_value, &value, sizeof(V)); \
+    return status; \
+} \
+\
+static inline void name##_remove(hashmap_t *const map, const K key) \
+{ \
+    hm_probe_t probe = hm_probe(map, hashfn(key)); \
+    void *value; \
+    if (name##_find_(&probe, key, &value)) hm_probe_erase(map, &probe); \
+}
+
+#endif/*_HM_TYPED_H_*/
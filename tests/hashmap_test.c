@@ -1,6 +1,9 @@
 #include "../src/hashmap.h"
+#include "../src/hm_typed.h"
 #include <check.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 static hashmap_t *map;
 
@@ -42,17 +45,40 @@ END_TEST
 
 START_TEST (test_hm_insert_full)
 {
-    int cap = hm_capacity(map);
+    const size_t cap = hm_capacity(map);
+    const int limit = cap * HM_DEFAULT_MAX_LOAD_FACTOR;
 
-    // full capacity
-    for (int i = 0; i < cap; ++i)
+    // fill up to the load limit
+    for (int i = 0; i < limit; ++i)
     {
         ck_assert_uint_eq(HM_SUCCESS, hm_insert(&map, &i, &i));
     }
 
-    cap = hm_capacity(map);
-    size_t count = hm_count(map);
-    ck_assert_uint_eq(count, cap);
+    ck_assert_uint_eq(hm_capacity(map), cap);
+    ck_assert_uint_eq(hm_count(map), limit);
+
+    // next insert grows the map
+    ck_assert_uint_eq(HM_SUCCESS, hm_insert(&map, &limit, &limit));
+    ck_assert_uint_eq(hm_capacity(map), 2 * cap);
+    ck_assert_uint_eq(hm_count(map), limit + 1);
+}
+END_TEST
+
+
+START_TEST (test_hm_tombstones_purge)
+{
+    const size_t cap = hm_capacity(map);
+
+    // churn never grows the map, tombstones get purged instead
+    for (int i = 0; i < (int)cap * 4; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&map, &i, &i));
+        hm_remove(map, &i);
+    }
+
+    ck_assert_uint_eq(hm_capacity(map), cap);
+    ck_assert_uint_eq(hm_count(map), 0);
+    ck_assert_uint_lt(hm_tombstones(map), cap);
 }
 END_TEST
 
@@ -86,6 +112,493 @@ START_TEST (test_hm_insert_rehash)
 END_TEST
 
 
+START_TEST (test_hm_capacity_policy)
+{
+    hashmap_t *pow2 = hm_create(
+        .key_size = sizeof(int),
+        .value_size = sizeof(int),
+        .hashfunc = hash_int,
+        .capacity = 100
+    );
+    hashmap_t *exact = hm_create(
+        .key_size = sizeof(int),
+        .value_size = sizeof(int),
+        .hashfunc = hash_int,
+        .capacity = 100,
+        .capacity_policy = HM_CAPACITY_EXACT
+    );
+
+    ck_assert_uint_eq(hm_capacity(pow2), 128);
+    ck_assert_uint_eq(hm_capacity(exact), 100);
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&pow2, &i, &i));
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&exact, &i, &i));
+    }
+
+    ck_assert_uint_eq(hm_capacity(pow2), 2048);
+    ck_assert_uint_eq(hm_capacity(exact), 1600);
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        ck_assert_mem_eq(hm_get(pow2, &i), &i, sizeof(int));
+        ck_assert_mem_eq(hm_get(exact, &i), &i, sizeof(int));
+    }
+
+    hm_destroy(pow2);
+    hm_destroy(exact);
+}
+END_TEST
+
+
+START_TEST (test_hm_robin_hood)
+{
+    hashmap_t *rh = hm_create(
+        .key_size = sizeof(int),
+        .value_size = sizeof(int),
+        .hashfunc = hash_int,
+        .probing = HM_PROBING_ROBIN_HOOD,
+        .max_load_factor = 0.9f
+    );
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&rh, &i, &i));
+    }
+    ck_assert_uint_eq(HM_ALREADY_EXISTS, hm_insert(&rh, &(int){10}, &(int){10}));
+
+    // delete every even key
+    for (int i = 0; i < 1000; i += 2)
+    {
+        hm_remove(rh, &i);
+    }
+
+    ck_assert_uint_eq(hm_count(rh), 500);
+    ck_assert_uint_eq(hm_tombstones(rh), 0);
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        int *value = hm_get(rh, &i);
+        if (i % 2)
+        {
+            ck_assert_ptr_nonnull(value);
+            ck_assert_int_eq(*value, i);
+        }
+        else
+        {
+            ck_assert_ptr_null(value);
+        }
+    }
+
+    hm_destroy(rh);
+}
+END_TEST
+
+
+static hash_t hash_constant(const void *const data, const size_t size)
+{
+    (void) data;
+    (void) size;
+    return 42;
+}
+
+
+START_TEST (test_hm_robin_hood_overflow)
+{
+    // every key shares a home slot, probe distances overflow at any capacity
+    hashmap_t *rh = hm_create(
+        .key_size = sizeof(int),
+        .value_size = sizeof(int),
+        .hashfunc = hash_constant,
+        .probing = HM_PROBING_ROBIN_HOOD
+    );
+
+    for (int i = 0; i < 300; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&rh, &i, &i));
+    }
+    ck_assert_uint_eq(hm_count(rh), 300);
+    ck_assert_uint_le(hm_capacity(rh), 2048);
+
+    for (int i = 0; i < 300; i += 3)
+    {
+        hm_remove(rh, &i);
+    }
+    for (int i = 0; i < 300; ++i)
+    {
+        int *value = hm_get(rh, &i);
+        if (i % 3)
+        {
+            ck_assert_ptr_nonnull(value);
+            ck_assert_int_eq(*value, i);
+        }
+        else
+        {
+            ck_assert_ptr_null(value);
+        }
+    }
+
+    hm_destroy(rh);
+}
+END_TEST
+
+
+START_TEST (test_hm_incremental_resize)
+{
+    hashmap_t *inc = hm_create(
+        .key_size = sizeof(int),
+        .value_size = sizeof(int),
+        .hashfunc = hash_int,
+        .capacity = 64,
+        .resize_step = 2
+    );
+
+    for (int i = 0; i < 5000; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&inc, &i, &i));
+        ck_assert_uint_eq(hm_count(inc), i + 1);
+
+        // mappings are reachable while migration is in progress
+        const int probe = i / 2;
+        ck_assert_mem_eq(hm_get(inc, &probe), &probe, sizeof(int));
+    }
+    ck_assert_uint_eq(HM_ALREADY_EXISTS, hm_insert(&inc, &(int){0}, &(int){0}));
+
+    hashmap_t *clone = hm_clone(inc);
+    ck_assert_uint_eq(hm_count(clone), 5000);
+
+    vector_t *keys = hm_keys(inc);
+    ck_assert_uint_eq(vector_capacity(keys), 5000);
+    vector_destroy(keys);
+
+    for (int i = 0; i < 5000; i += 2)
+    {
+        hm_remove(inc, &i);
+    }
+    ck_assert_uint_eq(hm_count(inc), 2500);
+
+    for (int i = 0; i < 5000; ++i)
+    {
+        ck_assert_ptr_nonnull(hm_get(clone, &i));
+        if (i % 2)
+        {
+            ck_assert_ptr_nonnull(hm_get(inc, &i));
+        }
+        else
+        {
+            ck_assert_ptr_null(hm_get(inc, &i));
+        }
+    }
+
+    hm_destroy(clone);
+    hm_destroy(inc);
+}
+END_TEST
+
+
+static size_t hash_calls;
+
+static hash_t counting_hash(const void *const key, const size_t size)
+{
+    ++hash_calls;
+    return hash_int(key, size);
+}
+
+
+START_TEST (test_hm_store_hash)
+{
+    hashmap_t *cached = hm_create(
+        .key_size = sizeof(int),
+        .value_size = sizeof(int),
+        .hashfunc = counting_hash,
+        .capacity = 16,
+        .store_hash = true
+    );
+
+    hash_calls = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&cached, &i, &i));
+    }
+
+    // growth reuses cached hash codes
+    ck_assert_uint_gt(hm_capacity(cached), 1000);
+    ck_assert_uint_eq(hash_calls, 1000);
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        ck_assert_mem_eq(hm_get(cached, &i), &i, sizeof(int));
+    }
+
+    hm_destroy(cached);
+}
+END_TEST
+
+
+static hash_t hash_bytes(const void *const key, const size_t size)
+{
+    // FNV-1a
+    hash_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ ((const unsigned char*)key)[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+
+START_TEST (test_hm_var_keys)
+{
+    hashmap_t *words = hm_create(
+        .value_size = sizeof(int),
+        .hashfunc = hash_bytes,
+        .capacity = 16,
+        .var_keys = true
+    );
+
+    char key[64];
+    for (int i = 0; i < 2000; ++i)
+    {
+        const int len = snprintf(key, sizeof(key), "key-%d-%.*s", i, i % 40, "........................................");
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert_var(&words, key, len, &i));
+    }
+    ck_assert_uint_eq(hm_count(words), 2000);
+
+    // prefix of the stored key is a different key
+    ck_assert_ptr_null(hm_get_var(words, "key-1", 4));
+    ck_assert_int_eq(*(int*)hm_get_var(words, "key-1-.", 7), 1);
+    ck_assert_ptr_nonnull(hm_get(words, &(hm_key_t){"key-0-", 6}));
+
+    hashmap_t *clone = hm_clone(words);
+
+    // churn leaves removed key bytes behind, arena gets compacted
+    for (int round = 0; round < 50; ++round)
+    {
+        for (int i = 0; i < 2000; i += 2)
+        {
+            const int len = snprintf(key, sizeof(key), "key-%d-%.*s", i, i % 40, "........................................");
+            hm_remove_var(words, key, len);
+            ck_assert_uint_eq(HM_SUCCESS, hm_insert_var(&words, key, len, &i));
+        }
+    }
+    ck_assert_uint_eq(hm_count(words), 2000);
+    hm_destroy(words);
+
+    for (int i = 0; i < 2000; ++i)
+    {
+        const int len = snprintf(key, sizeof(key), "key-%d-%.*s", i, i % 40, "........................................");
+        ck_assert_int_eq(*(int*)hm_get_var(clone, key, len), i);
+    }
+    hm_destroy(clone);
+}
+END_TEST
+
+
+static hash_t int_hash(const int key)
+{
+    return hash_int(&key, sizeof(key));
+}
+
+static bool int_eq(const int a, const int b)
+{
+    return a == b;
+}
+
+typedef struct point
+{
+    double x, y;
+}
+point_t;
+
+static hash_t u64_hash(const uint64_t key)
+{
+    return (hash_t)(key * 0x9e3779b97f4a7c15ull);
+}
+
+static bool u64_eq(const uint64_t a, const uint64_t b)
+{
+    return a == b;
+}
+
+HM_DECLARE(imap, int, int, int_hash, int_eq)
+HM_DECLARE(pmap, uint64_t, point_t, u64_hash, u64_eq)
+
+
+START_TEST (test_hm_typed)
+{
+    hashmap_t *ints = imap_create(16);
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, imap_insert(&ints, i, i * 2));
+    }
+    ck_assert_uint_eq(HM_ALREADY_EXISTS, imap_insert(&ints, 7, 0));
+    ck_assert_uint_eq(HM_SUCCESS, imap_upsert(&ints, 7, -7));
+    ck_assert_uint_eq(hm_count(ints), 1000);
+
+    for (int i = 0; i < 1000; i += 2)
+    {
+        imap_remove(ints, i);
+    }
+    ck_assert_uint_eq(hm_count(ints), 500);
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        ck_assert(imap_contains(ints, i) == (i % 2));
+    }
+    ck_assert_int_eq(*imap_get(ints, 7), -7);
+    ck_assert_int_eq(*imap_get(ints, 9), 18);
+
+    // typed map is a regular hashmap
+    ck_assert_int_eq(*(int*)hm_get(ints, &(int){11}), 22);
+
+    // hot path counters follow the library build, typed lookups count as generic ones
+    hm_stats_t before, typed, generic;
+    hm_stats(ints, &before);
+    ck_assert_ptr_nonnull(imap_get(ints, 13));
+    hm_stats(ints, &typed);
+    ck_assert_ptr_nonnull(hm_get(ints, &(int){13}));
+    hm_stats(ints, &generic);
+    ck_assert_uint_eq(typed.lookups - before.lookups, generic.lookups - typed.lookups);
+    ck_assert_uint_eq(typed.probes - before.probes, generic.probes - typed.probes);
+    hm_destroy(ints);
+
+    hashmap_t *points = pmap_create(4);
+    for (uint64_t i = 0; i < 100; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, pmap_insert(&points, i << 40, (point_t){i, -(double)i}));
+    }
+    ck_assert(pmap_get(points, 42ull << 40)->y == -42.0);
+    ck_assert_ptr_null(pmap_get(points, 42));
+    hm_destroy(points);
+}
+END_TEST
+
+
+START_TEST (test_hm_insert_many)
+{
+    enum { N = 3000 };
+    static int keys[N], values[N];
+    for (int i = 0; i < N; ++i)
+    {
+        keys[i] = i;
+        values[i] = -i;
+    }
+
+    hashmap_t *built = hm_build_from(keys, values, N,
+        .key_size = sizeof(int),
+        .value_size = sizeof(int),
+        .hashfunc = hash_int
+    );
+    ck_assert_ptr_nonnull(built);
+    ck_assert_uint_eq(hm_count(built), N);
+
+    // sized once, no growth while building
+    ck_assert_uint_ge(hm_capacity(built), N / HM_DEFAULT_MAX_LOAD_FACTOR);
+    ck_assert_uint_lt(hm_capacity(built), 2 * N / HM_DEFAULT_MAX_LOAD_FACTOR);
+
+    for (int i = 0; i < N; ++i)
+    {
+        ck_assert_int_eq(*(int*)hm_get(built, &i), -i);
+    }
+    hm_destroy(built);
+
+    // existing mappings are kept
+    ck_assert_uint_eq(HM_SUCCESS, hm_insert(&map, &(int){5}, &(int){55}));
+    ck_assert_uint_eq(HM_ALREADY_EXISTS, hm_insert_many(&map, keys, values, N));
+    ck_assert_uint_eq(hm_count(map), N);
+    ck_assert_int_eq(*(int*)hm_get(map, &(int){5}), 55);
+    ck_assert_int_eq(*(int*)hm_get(map, &(int){6}), -6);
+
+    // batch that fits doesn't cut incremental migration short
+    hashmap_t *inc = hm_create(
+        .key_size = sizeof(int),
+        .value_size = sizeof(int),
+        .hashfunc = hash_int,
+        .capacity = 64,
+        .resize_step = 2
+    );
+    int next = 0;
+    for (const size_t cap = hm_capacity(inc); cap == hm_capacity(inc); ++next)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&inc, &next, &next));
+    }
+    const size_t grown = hm_capacity(inc);
+    hm_stats_t before, after;
+    hm_stats(inc, &before);
+    ck_assert_uint_eq(HM_SUCCESS, hm_insert_many(&inc, keys + next, values + next, 1));
+    hm_stats(inc, &after);
+    ck_assert_uint_eq(after.rehashes, before.rehashes);
+    ck_assert_uint_eq(hm_capacity(inc), grown);
+    for (int i = 0; i <= next; ++i)
+    {
+        ck_assert_ptr_nonnull(hm_get(inc, &i));
+    }
+    hm_destroy(inc);
+
+    // rehash purging tombstones never shrinks the table
+    hashmap_t *run = hm_create(
+        .key_size = sizeof(int),
+        .value_size = sizeof(int),
+        .hashfunc = hash_constant,
+        .capacity = 128
+    );
+    ck_assert_uint_eq(HM_SUCCESS, hm_insert_many(&run, keys, values, 90));
+    for (int i = 0; i < 80; ++i)
+    {
+        hm_remove(run, &i);
+    }
+    ck_assert_uint_eq(hm_tombstones(run), 80);
+
+    ck_assert_uint_eq(HM_SUCCESS, hm_insert_many(&run, keys + 90, values + 90, 10));
+    ck_assert_uint_eq(hm_capacity(run), 128);
+    ck_assert_uint_eq(hm_count(run), 20);
+    ck_assert_uint_eq(hm_tombstones(run), 0);
+    hm_destroy(run);
+}
+END_TEST
+
+
+START_TEST (test_hm_get_batch)
+{
+    for (int i = 0; i < 100; ++i)
+    {
+        const int value = i * 3;
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&map, &i, &value));
+    }
+
+    // every other key is missing, batch spans several chunks
+    int keys[50];
+    for (int i = 0; i < 50; ++i)
+    {
+        keys[i] = i * 4;
+    }
+
+    void *values[50];
+    ck_assert_uint_eq(hm_get_batch(map, keys, 50, values), 25);
+
+    bool found[50];
+    ck_assert_uint_eq(hm_contains_batch(map, keys, 50, found), 25);
+
+    for (int i = 0; i < 50; ++i)
+    {
+        ck_assert(found[i] == (keys[i] < 100));
+        if (found[i])
+        {
+            ck_assert_int_eq(*(int*)values[i], keys[i] * 3);
+        }
+        else
+        {
+            ck_assert_ptr_null(values[i]);
+        }
+    }
+
+    ck_assert_uint_eq(hm_contains_batch(map, keys, 0, NULL), 0);
+}
+END_TEST
+
+
 START_TEST (test_hm_remove)
 {
     const int key = 534;
@@ -114,6 +627,320 @@ START_TEST (test_hm_remove)
 END_TEST
 
 
+START_TEST (test_hm_tombstones)
+{
+    // keys share the home slot, so they form one run longer than any group
+    hashmap_t *run = hm_create(
+        .key_size = sizeof(int),
+        .value_size = sizeof(int),
+        .hashfunc = hash_constant,
+        .capacity = 128
+    );
+
+    // lone slot is released without leaving a tombstone
+    const int lone = 100;
+    ck_assert_uint_eq(HM_SUCCESS, hm_insert(&run, &lone, &lone));
+    hm_remove(run, &lone);
+    ck_assert_uint_eq(hm_count(run), 0);
+    ck_assert_uint_eq(hm_tombstones(run), 0);
+
+    for (int i = 0; i < 40; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&run, &i, &i));
+    }
+    ck_assert_uint_eq(hm_count(run), 40);
+    ck_assert_uint_eq(hm_tombstones(run), 0);
+
+    // slots inside the full run are marked deleted
+    for (int i = 0; i < 5; ++i)
+    {
+        hm_remove(run, &i);
+    }
+    ck_assert_uint_eq(hm_count(run), 35);
+    ck_assert_uint_eq(hm_tombstones(run), 5);
+
+    // removing missing key changes nothing
+    const int missing = 100;
+    hm_remove(run, &missing);
+    ck_assert_uint_eq(hm_count(run), 35);
+    ck_assert_uint_eq(hm_tombstones(run), 5);
+
+    // reinserted keys must not be duplicated, they take the tombstones back
+    for (int i = 0; i < 10; ++i)
+    {
+        int value = i * 2;
+        ck_assert_uint_eq(HM_SUCCESS, hm_upsert(&run, &i, &value));
+    }
+    ck_assert_uint_eq(hm_count(run), 40);
+    ck_assert_uint_eq(hm_tombstones(run), 0);
+
+    for (int i = 0; i < 40; ++i)
+    {
+        ck_assert_int_eq(*(int*)hm_get(run, &i), i < 10 ? i * 2 : i);
+    }
+
+    for (int i = 0; i < 40; i += 4)
+    {
+        hm_remove(run, &i);
+    }
+    ck_assert_uint_eq(hm_tombstones(run), 10);
+
+    ck_assert_uint_eq(HM_SUCCESS, hm_shrink_reserve(&run, 1.0f));
+    ck_assert_uint_eq(hm_count(run), 30);
+    ck_assert_uint_eq(hm_tombstones(run), 0);
+
+    hm_destroy(run);
+}
+END_TEST
+
+
+START_TEST (test_hm_builtin_hash)
+{
+    // specialized kernels (4, 8, 16 bytes) and the generic one
+    const size_t sizes[] = {4, 8, 16, 3, 24, 100};
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+    {
+        hashmap_t *builtin = hm_create(
+            .key_size = sizes[s],
+            .value_size = sizeof(int)
+        );
+        ck_assert_ptr_nonnull(builtin);
+
+        unsigned char key[100] = {0};
+        for (int i = 0; i < 2000; ++i)
+        {
+            memcpy(key, &i, sizeof(i) < sizes[s] ? sizeof(i) : sizes[s]);
+            key[sizes[s] - 1] ^= (unsigned char)(i >> 8);
+            ck_assert_uint_eq(HM_SUCCESS, hm_insert(&builtin, key, &i));
+        }
+        ck_assert_uint_eq(hm_count(builtin), 2000);
+
+        for (int i = 0; i < 2000; ++i)
+        {
+            memcpy(key, &i, sizeof(i) < sizes[s] ? sizeof(i) : sizes[s]);
+            key[sizes[s] - 1] ^= (unsigned char)(i >> 8);
+            const int *value = hm_get(builtin, key);
+            ck_assert_ptr_nonnull(value);
+            ck_assert_int_eq(*value, i);
+        }
+        hm_destroy(builtin);
+    }
+
+    hashmap_t *words = hm_create(
+        .var_keys = true,
+        .value_size = sizeof(int),
+        .seed = 42
+    );
+    char word[32];
+    for (int i = 0; i < 1000; ++i)
+    {
+        const int len = snprintf(word, sizeof(word), "word-%d", i);
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&words, &(hm_key_t){word, len}, &i));
+    }
+    for (int i = 0; i < 1000; ++i)
+    {
+        const int len = snprintf(word, sizeof(word), "word-%d", i);
+        const int *value = hm_get(words, &(hm_key_t){word, len});
+        ck_assert_ptr_nonnull(value);
+        ck_assert_int_eq(*value, i);
+    }
+    hm_destroy(words);
+}
+END_TEST
+
+
+START_TEST (test_hm_stats)
+{
+    hm_stats_t stats;
+    hm_stats(map, &stats);
+    ck_assert_uint_eq(stats.used, 0);
+    ck_assert_uint_eq(stats.empty, stats.capacity);
+    ck_assert_uint_eq(stats.rehashes, 0);
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&map, &i, &i));
+    }
+    for (int i = 0; i < 100; ++i)
+    {
+        hm_remove(map, &i);
+    }
+
+    hm_stats(map, &stats);
+    ck_assert_uint_eq(stats.used, hm_count(map));
+    ck_assert_uint_eq(stats.used + stats.deleted + stats.empty, stats.capacity);
+    ck_assert_uint_gt(stats.rehashes, 0);
+    ck_assert_uint_gt(stats.bytes, stats.capacity * 2 * sizeof(int));
+    ck_assert_uint_ge(stats.max_cluster, 1);
+    ck_assert(stats.mean_probe <= (double)stats.max_probe);
+
+    size_t histogram = 0;
+    for (size_t i = 0; i < HM_STATS_BUCKETS; ++i)
+    {
+        histogram += stats.probe_histogram[i];
+    }
+    ck_assert_uint_eq(histogram, stats.used);
+}
+END_TEST
+
+
+START_TEST (test_hm_compact)
+{
+    // keys share the home slot, removals inside the run leave tombstones
+    hashmap_t *run = hm_create(
+        .key_size = sizeof(int),
+        .value_size = sizeof(int),
+        .hashfunc = hash_constant,
+        .capacity = 128
+    );
+    const size_t cap = hm_capacity(run);
+
+    for (int i = 0; i < 64; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&run, &i, &i));
+    }
+    for (int i = 0; i < 64; i += 2)
+    {
+        hm_remove(run, &i);
+    }
+    ck_assert_uint_gt(hm_tombstones(run), 0);
+    ck_assert_uint_eq(hm_count(run), 32);
+
+    hm_compact(run);
+
+    ck_assert_uint_eq(hm_tombstones(run), 0);
+    ck_assert_uint_eq(hm_capacity(run), cap);
+    ck_assert_uint_eq(hm_count(run), 32);
+
+    for (int i = 0; i < 64; ++i)
+    {
+        int *value = hm_get(run, &i);
+        if (i % 2)
+        {
+            ck_assert_ptr_nonnull(value);
+            ck_assert_int_eq(*value, i);
+        }
+        else
+        {
+            ck_assert_ptr_null(value);
+        }
+    }
+
+    // freed slots are usable again
+    for (int i = 0; i < 64; i += 2)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&run, &i, &i));
+    }
+    ck_assert_uint_eq(hm_count(run), 64);
+    ck_assert_uint_eq(hm_tombstones(run), 0);
+    ck_assert_uint_eq(hm_capacity(run), cap);
+
+    hm_destroy(run);
+}
+END_TEST
+
+
+START_TEST (test_hm_clear)
+{
+    for (int i = 0; i < 1000; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&map, &i, &i));
+    }
+    for (int i = 0; i < 1000; i += 2)
+    {
+        hm_remove(map, &i);
+    }
+    const size_t cap = hm_capacity(map);
+
+    hm_clear(map);
+
+    ck_assert_uint_eq(hm_count(map), 0);
+    ck_assert_uint_eq(hm_tombstones(map), 0);
+    ck_assert_uint_eq(hm_capacity(map), cap);
+    for (int i = 0; i < 1000; ++i)
+    {
+        ck_assert_ptr_null(hm_get(map, &i));
+    }
+
+    // storage is reused, variable length keys included
+    hashmap_t *var = hm_create(.var_keys = true, .value_size = sizeof(int), .hashfunc = hash_str);
+    for (int round = 0; round < 3; ++round)
+    {
+        for (int i = 0; i < 1000; ++i)
+        {
+            char key[16];
+            const int len = snprintf(key, sizeof(key), "key%d", i + round);
+            ck_assert_uint_eq(HM_SUCCESS, hm_insert(&map, &i, &round));
+            ck_assert_uint_eq(HM_SUCCESS, hm_insert_var(&var, key, len, &i));
+        }
+        ck_assert_uint_eq(hm_count(var), 1000);
+        ck_assert_int_eq(*(int*)hm_get_var(var, "key500", 6), 500 - round);
+
+        hm_clear(map);
+        hm_clear(var);
+        ck_assert_ptr_null(hm_get_var(var, "key500", 6));
+    }
+    ck_assert_uint_eq(hm_capacity(map), cap);
+    hm_destroy(var);
+}
+END_TEST
+
+
+START_TEST (test_hm_pages)
+{
+    const hm_pages_t pages[] = {HM_PAGES_TRANSPARENT, HM_PAGES_HUGETLB};
+    const hm_numa_t numa[] = {HM_NUMA_INTERLEAVE, HM_NUMA_BIND};
+
+    // policies apply where supported, the map works the same either way
+    for (int p = 0; p < 2; ++p)
+    {
+        hashmap_t *paged = hm_create(
+            .key_size = sizeof(int),
+            .value_size = sizeof(int),
+            .hashfunc = hash_int,
+            .pages = pages[p],
+            .numa = numa[p],
+            .nthreads = 2 * p
+        );
+        ck_assert_ptr_nonnull(paged);
+
+        for (int i = 0; i < 200000; ++i)
+        {
+            ck_assert_uint_eq(HM_SUCCESS, hm_insert(&paged, &i, &i));
+        }
+        for (int i = 0; i < 200000; i += 2)
+        {
+            hm_remove(paged, &i);
+        }
+
+        hashmap_t *clone = hm_clone(paged);
+        ck_assert_ptr_nonnull(clone);
+        hm_clear(paged);
+        ck_assert_uint_eq(hm_count(paged), 0);
+
+        ck_assert_uint_eq(hm_count(clone), 100000);
+        for (int i = 0; i < 200000; ++i)
+        {
+            int *value = hm_get(clone, &i);
+            if (i % 2)
+            {
+                ck_assert_ptr_nonnull(value);
+                ck_assert_int_eq(*value, i);
+            }
+            else
+            {
+                ck_assert_ptr_null(value);
+            }
+        }
+
+        hm_destroy(clone);
+        hm_destroy(paged);
+    }
+}
+END_TEST
+
+
 START_TEST (test_hm_keys_values)
 {
     const int expected_cap = 10;
@@ -142,6 +969,116 @@ START_TEST (test_hm_keys_values)
 }
 END_TEST
 
+
+START_TEST (test_hm_entries_into)
+{
+    for (int key = 0; key < 100; ++key)
+    {
+        int val = key + 10;
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&map, &key, &val));
+    }
+
+    int keys[100], values[100];
+    ck_assert_uint_eq(hm_entries_into(map, keys, values, 100), 100);
+    for (int i = 0; i < 100; ++i)
+    {
+        ck_assert_int_eq(values[i], keys[i] + 10);
+    }
+
+    // partial fills continue where the iterator stopped
+    int more_keys[100];
+    hm_iter_t it = hm_iter(map);
+    ck_assert_uint_eq(hm_iter_entries(&it, more_keys, NULL, 60), 60);
+    ck_assert_uint_eq(hm_iter_entries(&it, more_keys + 60, NULL, 60), 40);
+    ck_assert_mem_eq(more_keys, keys, sizeof(keys));
+
+    ck_assert_uint_eq(hm_keys_into(map, more_keys, 10), 10);
+    ck_assert_uint_eq(hm_values_into(map, values, 100), 100);
+
+    hm_span_t spans[HM_MAX_SPANS];
+    const size_t span_count = hm_entries_span(map, spans);
+    ck_assert_uint_eq(span_count, 1);
+
+    size_t used = 0;
+    for (size_t i = 0; i < spans[0].capacity; ++i)
+    {
+        if (spans[0].ctrl[i] < 0) continue;
+
+        const char *slot = spans[0].slots + i * spans[0].stride;
+        ck_assert_int_eq(*(const int*)(slot + spans[0].value_offset), *(const int*)slot + 10);
+        ++used;
+    }
+    ck_assert_uint_eq(used, 100);
+}
+END_TEST
+
+
+static int sum_values(const void *const key, const void *const value, void *const acc, void *const param)
+{
+    (void) key;
+    (void) param;
+    *(long*)acc += *(const int*)value;
+    return 0;
+}
+
+static int double_value(const void *const key, void *const value, void *const param)
+{
+    (void) key;
+    (void) param;
+    *(int*)value *= 2;
+    return 0;
+}
+
+
+START_TEST (test_hm_iter)
+{
+    hashmap_t *sparse = hm_create(
+        .key_size = sizeof(int),
+        .value_size = sizeof(int),
+        .hashfunc = hash_int,
+        .capacity = 4096,
+        .resize_step = 1
+    );
+
+    // grows incrementally, then few mappings stay scattered over large table
+    for (int i = 0; i < 3100; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&sparse, &i, &i));
+    }
+
+    long expected = 0;
+    for (int i = 0; i < 3100; ++i)
+    {
+        if (i % 97) hm_remove(sparse, &i);
+        else expected += i;
+    }
+
+    size_t visited = 0;
+    long sum = 0;
+    const void *key;
+    void *value;
+    hm_iter_t it = hm_iter(sparse);
+    while (hm_iter_next(&it, &key, &value))
+    {
+        ck_assert_int_eq(*(const int*)key, *(int*)value);
+        ck_assert_int_eq(*(const int*)key % 97, 0);
+        sum += *(int*)value;
+        ++visited;
+    }
+    ck_assert_uint_eq(visited, hm_count(sparse));
+    ck_assert_int_eq(sum, expected);
+    ck_assert(!hm_iter_next(&it, NULL, NULL));
+
+    ck_assert_int_eq(hm_transform(sparse, double_value, NULL), 0);
+
+    sum = 0;
+    ck_assert_int_eq(hm_aggregate(sparse, sum_values, &sum, NULL), 0);
+    ck_assert_int_eq(sum, 2 * expected);
+
+    hm_destroy(sparse);
+}
+END_TEST
+
 Suite *hash_map_suite(void)
 {
     Suite *s;
@@ -157,8 +1094,26 @@ Suite *hash_map_suite(void)
     tcase_add_test(tc_core, test_hm_insert);
     tcase_add_test(tc_core, test_hm_insert_full);
     tcase_add_test(tc_core, test_hm_insert_rehash);
+    tcase_add_test(tc_core, test_hm_tombstones_purge);
+    tcase_add_test(tc_core, test_hm_capacity_policy);
+    tcase_add_test(tc_core, test_hm_robin_hood);
+    tcase_add_test(tc_core, test_hm_robin_hood_overflow);
+    tcase_add_test(tc_core, test_hm_incremental_resize);
+    tcase_add_test(tc_core, test_hm_store_hash);
+    tcase_add_test(tc_core, test_hm_var_keys);
+    tcase_add_test(tc_core, test_hm_typed);
+    tcase_add_test(tc_core, test_hm_insert_many);
+    tcase_add_test(tc_core, test_hm_get_batch);
     tcase_add_test(tc_core, test_hm_remove);
+    tcase_add_test(tc_core, test_hm_tombstones);
+    tcase_add_test(tc_core, test_hm_builtin_hash);
+    tcase_add_test(tc_core, test_hm_stats);
+    tcase_add_test(tc_core, test_hm_compact);
+    tcase_add_test(tc_core, test_hm_clear);
+    tcase_add_test(tc_core, test_hm_pages);
     tcase_add_test(tc_core, test_hm_keys_values);
+    tcase_add_test(tc_core, test_hm_entries_into);
+    tcase_add_test(tc_core, test_hm_iter);
 
     suite_add_tcase(s, tc_core);
 
@@ -0,0 +1,184 @@
+#include "../src/hm_concurrent.h"
+#include <check.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#define READERS 6
+#define KEYS 100000
+
+static hm_concurrent_t *map;
+static atomic_int published; /* keys below are inserted */
+static atomic_bool removing; /* even keys may be missing */
+static atomic_bool done;
+
+static void setup_empty(void)
+{
+    map = hm_concurrent_create(
+        .key_size = sizeof(int),
+        .value_size = sizeof(int),
+        .hashfunc = hash_int,
+        .capacity = 16
+    );
+    atomic_store(&published, 0);
+    atomic_store(&removing, false);
+    atomic_store(&done, false);
+}
+
+static void teardown(void)
+{
+    hm_concurrent_destroy(map);
+}
+
+
+START_TEST (test_hm_concurrent_basic)
+{
+    ck_assert_ptr_nonnull(map);
+
+    hm_reader_t *reader = hm_reader_register(map);
+    ck_assert_ptr_nonnull(reader);
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_concurrent_insert(map, &i, &(int){2 * i}));
+    }
+    ck_assert_uint_eq(HM_ALREADY_EXISTS, hm_concurrent_insert(map, &(int){3}, &(int){0}));
+    ck_assert_uint_eq(HM_SUCCESS, hm_concurrent_upsert(map, &(int){3}, &(int){-3}));
+    ck_assert_uint_eq(hm_concurrent_count(map), 1000);
+
+    int value;
+    ck_assert(hm_concurrent_get(reader, &(int){3}, &value));
+    ck_assert_int_eq(value, -3);
+    ck_assert(hm_concurrent_get(reader, &(int){999}, &value));
+    ck_assert_int_eq(value, 1998);
+
+    hm_concurrent_remove(map, &(int){3});
+    ck_assert(!hm_concurrent_get(reader, &(int){3}, NULL));
+    ck_assert_uint_eq(hm_concurrent_count(map), 999);
+
+    hm_reader_unregister(reader);
+
+    hm_reader_t *readers[HM_MAX_READERS];
+    for (size_t i = 0; i < HM_MAX_READERS; ++i)
+    {
+        readers[i] = hm_reader_register(map);
+        ck_assert_ptr_nonnull(readers[i]);
+    }
+    ck_assert_ptr_null(hm_reader_register(map));
+
+    for (size_t i = 0; i < HM_MAX_READERS; ++i)
+    {
+        hm_reader_unregister(readers[i]);
+    }
+}
+END_TEST
+
+
+static void *reader_thread(void *arg)
+{
+    (void) arg;
+    hm_reader_t *reader = hm_reader_register(map);
+    if (!reader) return map;
+
+    unsigned int seed = 1;
+
+    while (!atomic_load(&done))
+    {
+        const int limit = atomic_load(&published);
+        if (!limit) continue;
+
+        const int key = rand_r(&seed) % limit;
+        int value;
+
+        if (hm_concurrent_get(reader, &key, &value))
+        {
+            if (value != 3 * key) return map;
+        }
+        else if (!atomic_load(&removing) || key % 2)
+        {
+            return map;
+        }
+    }
+
+    hm_reader_unregister(reader);
+    return NULL;
+}
+
+
+START_TEST (test_hm_concurrent_readers)
+{
+    pthread_t threads[READERS];
+
+    for (int t = 0; t < READERS; ++t)
+    {
+        ck_assert_int_eq(0, pthread_create(&threads[t], NULL, reader_thread, NULL));
+    }
+
+    // keys get published once inserted, the table grows many times meanwhile
+    for (int i = 0; i < KEYS; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_concurrent_insert(map, &i, &(int){3 * i}));
+        atomic_store(&published, i + 1);
+    }
+
+    atomic_store(&removing, true);
+    for (int i = 0; i < KEYS; i += 2)
+    {
+        hm_concurrent_remove(map, &i);
+    }
+
+    // tombstones left by removal get purged by copying the table aside
+    for (int i = 0; i < KEYS; i += 2)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_concurrent_insert(map, &i, &(int){3 * i}));
+    }
+
+    atomic_store(&done, true);
+
+    for (int t = 0; t < READERS; ++t)
+    {
+        void *result;
+        ck_assert_int_eq(0, pthread_join(threads[t], &result));
+        ck_assert_ptr_null(result);
+    }
+
+    ck_assert_uint_eq(hm_concurrent_count(map), KEYS);
+}
+END_TEST
+
+
+Suite *hash_map_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create("Concurrent Hash Map");
+
+    /* Core test case */
+    tc_core = tcase_create("Core");
+
+    tcase_add_checked_fixture(tc_core, setup_empty, teardown);
+    tcase_add_test(tc_core, test_hm_concurrent_basic);
+    tcase_add_test(tc_core, test_hm_concurrent_readers);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = hash_map_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
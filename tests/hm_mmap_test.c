@@ -0,0 +1,225 @@
+#include "../src/hm_mmap.h"
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define IMAGE_PATH "hm_mmap_test.img"
+#define KEYS 10000
+
+static hashmap_t *map;
+
+static void setup_filled(void)
+{
+    ck_assert(hm_register_hashfunc(1, hash_int));
+
+    map = hm_create(
+        .key_size = sizeof(int),
+        .value_size = sizeof(int),
+        .hashfunc = hash_int
+    );
+
+    for (int i = 0; i < KEYS; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&map, &i, &(int){2 * i}));
+    }
+    for (int i = 0; i < KEYS; i += 10)
+    {
+        hm_remove(map, &i);
+    }
+}
+
+static void teardown(void)
+{
+    hm_destroy(map);
+    remove(IMAGE_PATH);
+}
+
+
+static void check_contents(const hashmap_t *const opened)
+{
+    ck_assert_uint_eq(hm_count(opened), hm_count(map));
+    ck_assert_uint_eq(hm_capacity(opened), hm_capacity(map));
+
+    for (int i = 0; i < KEYS; ++i)
+    {
+        const int *value = hm_get(opened, &i);
+        if (i % 10 == 0)
+        {
+            ck_assert_ptr_null(value);
+        }
+        else
+        {
+            ck_assert_ptr_nonnull(value);
+            ck_assert_int_eq(*value, 2 * i);
+        }
+    }
+}
+
+
+START_TEST (test_hm_open_read_only)
+{
+    ck_assert_uint_eq(HM_SUCCESS, hm_save(map, IMAGE_PATH));
+
+    hashmap_t *opened = hm_open_mmap(IMAGE_PATH, HM_MAP_READ_ONLY);
+    ck_assert_ptr_nonnull(opened);
+    check_contents(opened);
+
+    // clone moves the table into regular memory
+    hashmap_t *clone = hm_clone(opened);
+    ck_assert_ptr_nonnull(clone);
+    ck_assert_uint_eq(HM_SUCCESS, hm_insert(&clone, &(int){-1}, &(int){0}));
+    ck_assert_uint_eq(hm_count(clone), hm_count(map) + 1);
+
+    hm_destroy(clone);
+    hm_destroy(opened);
+}
+END_TEST
+
+
+START_TEST (test_hm_open_copy_on_write)
+{
+    ck_assert_uint_eq(HM_SUCCESS, hm_save(map, IMAGE_PATH));
+
+    hashmap_t *opened = hm_open_mmap(IMAGE_PATH, HM_MAP_COPY_ON_WRITE);
+    ck_assert_ptr_nonnull(opened);
+
+    // writes go to private pages, growth moves the map out of the image
+    for (int i = KEYS; i < 4 * KEYS; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&opened, &i, &(int){2 * i}));
+    }
+    hm_remove(opened, &(int){1});
+    ck_assert_ptr_null(hm_get(opened, &(int){1}));
+    ck_assert_int_eq(*(int*)hm_get(opened, &(int){3 * KEYS}), 6 * KEYS);
+    hm_destroy(opened);
+
+    opened = hm_open_mmap(IMAGE_PATH, HM_MAP_COPY_ON_WRITE);
+    ck_assert_ptr_nonnull(opened);
+    check_contents(opened);
+    hm_destroy(opened);
+}
+END_TEST
+
+
+static hash_t hash_unregistered(const void *const data, const size_t size)
+{
+    return hash_int(data, size);
+}
+
+
+START_TEST (test_hm_save_errors)
+{
+    ck_assert(hm_register_hashfunc(1, hash_int));
+    ck_assert(!hm_register_hashfunc(1, hash_unregistered));
+
+    hashmap_t *other = hm_create(
+        .key_size = sizeof(int),
+        .value_size = sizeof(int),
+        .hashfunc = hash_unregistered
+    );
+    ck_assert_uint_eq(HM_UNKNOWN_HASHFUNC, hm_save(other, IMAGE_PATH));
+    hm_destroy(other);
+
+    ck_assert_ptr_null(hm_open_mmap(IMAGE_PATH, HM_MAP_READ_ONLY));
+
+    // truncated image is rejected
+    ck_assert_uint_eq(HM_SUCCESS, hm_save(map, IMAGE_PATH));
+    FILE *file = fopen(IMAGE_PATH, "r+b");
+    ck_assert_ptr_nonnull(file);
+    ck_assert_int_eq(0, ftruncate(fileno(file), 200));
+    fclose(file);
+    ck_assert_ptr_null(hm_open_mmap(IMAGE_PATH, HM_MAP_READ_ONLY));
+
+    // key size wrapping around in slot size computation is rejected
+    // (key_size and value_size are at offsets 32 and 40 of the image header)
+    ck_assert_uint_eq(HM_SUCCESS, hm_save(map, IMAGE_PATH));
+    file = fopen(IMAGE_PATH, "r+b");
+    ck_assert_ptr_nonnull(file);
+    const uint64_t sizes[2] = {UINT64_MAX - 6, 16};
+    ck_assert_int_eq(0, fseek(file, 32, SEEK_SET));
+    ck_assert_uint_eq(2, fwrite(sizes, sizeof(uint64_t), 2, file));
+    fclose(file);
+    ck_assert_ptr_null(hm_open_mmap(IMAGE_PATH, HM_MAP_READ_ONLY));
+
+    // slots of variable length keys point into the arena
+    hashmap_t *var = hm_create(
+        .var_keys = true,
+        .value_size = sizeof(int),
+        .hashfunc = hash_int
+    );
+    ck_assert_uint_eq(HM_UNSUPPORTED, hm_save(var, IMAGE_PATH));
+    hm_destroy(var);
+}
+END_TEST
+
+
+START_TEST (test_hm_save_builtin)
+{
+    ck_assert(!hm_register_hashfunc(HM_BUILTIN_HASHFUNC_ID, hash_int));
+
+    hashmap_t *builtin = hm_create(
+        .key_size = sizeof(int),
+        .value_size = sizeof(int)
+    );
+    for (int i = 0; i < KEYS; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&builtin, &i, &(int){2 * i}));
+    }
+
+    // seed is saved with the image, keys hash to the same codes after opening
+    ck_assert_uint_eq(HM_SUCCESS, hm_save(builtin, IMAGE_PATH));
+    hashmap_t *opened = hm_open_mmap(IMAGE_PATH, HM_MAP_READ_ONLY);
+    ck_assert_ptr_nonnull(opened);
+    ck_assert_uint_eq(hm_count(opened), KEYS);
+
+    for (int i = 0; i < KEYS; ++i)
+    {
+        const int *value = hm_get(opened, &i);
+        ck_assert_ptr_nonnull(value);
+        ck_assert_int_eq(*value, 2 * i);
+    }
+
+    hm_destroy(opened);
+    hm_destroy(builtin);
+}
+END_TEST
+
+
+Suite *hash_map_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create("Hash Map Images");
+
+    /* Core test case */
+    tc_core = tcase_create("Core");
+
+    tcase_add_checked_fixture(tc_core, setup_filled, teardown);
+    tcase_add_test(tc_core, test_hm_open_read_only);
+    tcase_add_test(tc_core, test_hm_open_copy_on_write);
+    tcase_add_test(tc_core, test_hm_save_errors);
+    tcase_add_test(tc_core, test_hm_save_builtin);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = hash_map_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,213 @@
+#include "../src/hm_parallel.h"
+#include <check.h>
+#include <stdlib.h>
+
+#define KEYS 200000
+
+static hashmap_t *map;
+
+static void setup_empty(void)
+{
+    map = hm_create(
+        .key_size = sizeof(int),
+        .value_size = sizeof(long),
+        .hashfunc = hash_int
+    );
+}
+
+static void teardown(void)
+{
+    hm_destroy(map);
+}
+
+
+static int sum_values(const void *const key, const void *const value, void *const acc, void *const param)
+{
+    (void) key;
+    (void) param;
+    *(long*)acc += *(const long*)value;
+    return 0;
+}
+
+
+static void add_sums(void *const acc, const void *const other, void *const param)
+{
+    (void) param;
+    *(long*)acc += *(const long*)other;
+}
+
+
+static int triple_value(const void *const key, void *const value, void *const param)
+{
+    (void) param;
+    if (*(const int*)key == -1) return 42;
+    *(long*)value *= 3;
+    return 0;
+}
+
+
+START_TEST (test_hm_parallel_aggregate)
+{
+    long expected = 0;
+    for (int i = 0; i < KEYS; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&map, &i, &(long){i}));
+        expected += i;
+    }
+
+    const size_t threads[] = {0, 1, 3, 8};
+    for (size_t t = 0; t < sizeof(threads) / sizeof(*threads); ++t)
+    {
+        long sum = 0;
+        ck_assert_int_eq(0, hm_parallel_aggregate(map, threads[t], sum_values, add_sums, &sum, sizeof(sum), NULL));
+        ck_assert_int_eq(sum, expected);
+    }
+
+    ck_assert_int_eq(0, hm_parallel_transform(map, 4, triple_value, NULL));
+
+    long sum = 0;
+    ck_assert_int_eq(0, hm_aggregate(map, sum_values, &sum, NULL));
+    ck_assert_int_eq(sum, 3 * expected);
+
+    // first failure stops the traversal
+    ck_assert_uint_eq(HM_SUCCESS, hm_insert(&map, &(int){-1}, &(long){0}));
+    ck_assert_int_eq(42, hm_parallel_transform(map, 4, triple_value, NULL));
+}
+END_TEST
+
+
+START_TEST (test_hm_parallel_small)
+{
+    long sum = 0;
+    ck_assert_int_eq(0, hm_parallel_aggregate(map, 4, sum_values, add_sums, &sum, sizeof(sum), NULL));
+    ck_assert_int_eq(sum, 0);
+
+    for (int i = 0; i < 10; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&map, &i, &(long){i}));
+    }
+
+    ck_assert_int_eq(0, hm_parallel_aggregate(map, 4, sum_values, add_sums, &sum, sizeof(sum), NULL));
+    ck_assert_int_eq(sum, 45);
+}
+END_TEST
+
+
+START_TEST (test_hm_parallel_rehash)
+{
+    hashmap_t *threaded = hm_create(
+        .key_size = sizeof(int),
+        .value_size = sizeof(long),
+        .hashfunc = hash_int,
+        .nthreads = 4
+    );
+
+    // growth past the threshold places mappings by several threads
+    for (int i = 0; i < KEYS; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&threaded, &i, &(long){-i}));
+    }
+    for (int i = 0; i < KEYS; i += 3)
+    {
+        hm_remove(threaded, &i);
+    }
+    ck_assert_uint_eq(HM_SUCCESS, hm_shrink_reserve(&threaded, 1.0f));
+
+    ck_assert_uint_eq(hm_count(threaded), KEYS - (KEYS + 2) / 3);
+    for (int i = 0; i < KEYS; ++i)
+    {
+        const long *value = hm_get(threaded, &i);
+        if (i % 3 == 0)
+        {
+            ck_assert_ptr_null(value);
+        }
+        else
+        {
+            ck_assert_ptr_nonnull(value);
+            ck_assert_int_eq(*value, -i);
+        }
+    }
+
+    hm_destroy(threaded);
+}
+END_TEST
+
+
+START_TEST (test_hm_parallel_build)
+{
+    int *keys = malloc(KEYS * sizeof(int));
+    long *values = malloc(KEYS * sizeof(long));
+    ck_assert_ptr_nonnull(keys);
+    ck_assert_ptr_nonnull(values);
+
+    // every key goes twice, the first value wins
+    for (int i = 0; i < KEYS; ++i)
+    {
+        keys[i] = i % (KEYS / 2);
+        values[i] = i;
+    }
+
+    hashmap_t *built = hm_build_from(keys, values, KEYS,
+        .key_size = sizeof(int),
+        .value_size = sizeof(long),
+        .hashfunc = hash_int,
+        .store_hash = true,
+        .nthreads = 8
+    );
+    ck_assert_ptr_nonnull(built);
+    ck_assert_uint_eq(hm_count(built), KEYS / 2);
+
+    for (int i = 0; i < KEYS / 2; ++i)
+    {
+        const long *value = hm_get(built, &i);
+        ck_assert_ptr_nonnull(value);
+        ck_assert_int_eq(*value, i);
+    }
+
+    ck_assert_uint_eq(HM_SUCCESS, hm_insert(&built, &(int){-1}, &(long){0}));
+    ck_assert_uint_eq(HM_ALREADY_EXISTS, hm_insert(&built, &(int){7}, &(long){0}));
+
+    hm_destroy(built);
+    free(keys);
+    free(values);
+}
+END_TEST
+
+
+Suite *hash_map_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create("Parallel Hash Map");
+
+    /* Core test case */
+    tc_core = tcase_create("Core");
+
+    tcase_add_checked_fixture(tc_core, setup_empty, teardown);
+    tcase_add_test(tc_core, test_hm_parallel_aggregate);
+    tcase_add_test(tc_core, test_hm_parallel_small);
+    tcase_add_test(tc_core, test_hm_parallel_rehash);
+    tcase_add_test(tc_core, test_hm_parallel_build);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = hash_map_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,105 @@
+#include "../src/hm_pool.h"
+#include <check.h>
+#include <stdlib.h>
+
+static hm_pool_t *pool;
+
+static void setup_pool(void)
+{
+    pool = hm_pool_create(2,
+        .key_size = sizeof(int),
+        .value_size = sizeof(int),
+        .hashfunc = hash_int
+    );
+}
+
+static void teardown(void)
+{
+    hm_pool_destroy(pool);
+}
+
+
+START_TEST (test_hm_pool_recycle)
+{
+    hashmap_t *map = hm_pool_acquire(pool);
+    ck_assert_ptr_nonnull(map);
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&map, &i, &i));
+    }
+    const size_t cap = hm_capacity(map);
+
+    hm_pool_release(pool, map);
+    ck_assert_uint_eq(hm_pool_idle(pool), 1);
+
+    // the same storage comes back empty, grown capacity is kept
+    hashmap_t *again = hm_pool_acquire(pool);
+    ck_assert_ptr_eq(again, map);
+    ck_assert_uint_eq(hm_pool_idle(pool), 0);
+    ck_assert_uint_eq(hm_count(again), 0);
+    ck_assert_uint_eq(hm_capacity(again), cap);
+    ck_assert_ptr_null(hm_get(again, &(int){7}));
+
+    ck_assert_uint_eq(HM_SUCCESS, hm_insert(&again, &(int){7}, &(int){1}));
+    ck_assert_int_eq(*(int*)hm_get(again, &(int){7}), 1);
+
+    hm_pool_release(pool, again);
+}
+END_TEST
+
+
+START_TEST (test_hm_pool_full)
+{
+    hashmap_t *maps[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        maps[i] = hm_pool_acquire(pool);
+        ck_assert_ptr_nonnull(maps[i]);
+    }
+
+    // the pool keeps two idle maps, the third one is destroyed
+    for (int i = 0; i < 3; ++i)
+    {
+        hm_pool_release(pool, maps[i]);
+    }
+    ck_assert_uint_eq(hm_pool_idle(pool), 2);
+}
+END_TEST
+
+
+Suite *hash_map_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create("Hash Map Pool");
+
+    /* Core test case */
+    tc_core = tcase_create("Core");
+
+    tcase_add_checked_fixture(tc_core, setup_pool, teardown);
+    tcase_add_test(tc_core, test_hm_pool_recycle);
+    tcase_add_test(tc_core, test_hm_pool_full);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = hash_map_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,150 @@
+#include "../src/hm_sharded.h"
+#include <check.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#define THREADS 8
+#define KEYS_PER_THREAD 20000
+
+static hm_sharded_t *map;
+
+static void setup_empty(void)
+{
+    map = hm_sharded_create(16,
+        .key_size = sizeof(int),
+        .value_size = sizeof(int),
+        .hashfunc = hash_int
+    );
+}
+
+static void teardown(void)
+{
+    hm_sharded_destroy(map);
+}
+
+
+START_TEST (test_hm_sharded_basic)
+{
+    ck_assert_ptr_nonnull(map);
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_sharded_insert(map, &i, &i));
+    }
+    ck_assert_uint_eq(HM_ALREADY_EXISTS, hm_sharded_insert(map, &(int){3}, &(int){0}));
+    ck_assert_uint_eq(hm_sharded_count(map), 1000);
+
+    ck_assert(hm_sharded_update(map, &(int){3}, &(int){-3}));
+    ck_assert(!hm_sharded_update(map, &(int){5000}, &(int){0}));
+    ck_assert_uint_eq(HM_SUCCESS, hm_sharded_upsert(map, &(int){5000}, &(int){5}));
+
+    int value;
+    ck_assert(hm_sharded_get(map, &(int){3}, &value));
+    ck_assert_int_eq(value, -3);
+    ck_assert(hm_sharded_get(map, &(int){5000}, &value));
+    ck_assert_int_eq(value, 5);
+
+    hm_sharded_remove(map, &(int){5000});
+    ck_assert(!hm_sharded_get(map, &(int){5000}, NULL));
+    ck_assert_uint_eq(hm_sharded_count(map), 1000);
+}
+END_TEST
+
+
+static void *writer(void *arg)
+{
+    const int base = *(int*)arg * KEYS_PER_THREAD;
+
+    for (int i = base; i < base + KEYS_PER_THREAD; ++i)
+    {
+        if (HM_SUCCESS != hm_sharded_insert(map, &i, &i)) return arg;
+    }
+
+    // odd keys get updated, every fourth removed, other threads keep reading
+    for (int i = base; i < base + KEYS_PER_THREAD; ++i)
+    {
+        const int neighbour = (i + KEYS_PER_THREAD) % (THREADS * KEYS_PER_THREAD);
+        (void) hm_sharded_get(map, &neighbour, NULL);
+
+        if (i % 4 == 0) hm_sharded_remove(map, &i);
+        else if (i % 2) hm_sharded_upsert(map, &i, &(int){-i});
+    }
+
+    return NULL;
+}
+
+
+static int check_value(const void *const key, const void *const value, void *const param)
+{
+    const int k = *(const int*)key;
+    const int v = *(const int*)value;
+    ++*(size_t*)param;
+
+    if (k % 4 == 0) return 1;
+    return (k % 2) ? (v != -k) : (v != k);
+}
+
+
+START_TEST (test_hm_sharded_threads)
+{
+    pthread_t threads[THREADS];
+    int ids[THREADS];
+
+    for (int t = 0; t < THREADS; ++t)
+    {
+        ids[t] = t;
+        ck_assert_int_eq(0, pthread_create(&threads[t], NULL, writer, &ids[t]));
+    }
+
+    for (int t = 0; t < THREADS; ++t)
+    {
+        void *result;
+        ck_assert_int_eq(0, pthread_join(threads[t], &result));
+        ck_assert_ptr_null(result);
+    }
+
+    const size_t expected = THREADS * KEYS_PER_THREAD / 4 * 3;
+    ck_assert_uint_eq(hm_sharded_count(map), expected);
+
+    size_t visited = 0;
+    ck_assert_int_eq(0, hm_sharded_foreach(map, check_value, &visited));
+    ck_assert_uint_eq(visited, expected);
+}
+END_TEST
+
+
+Suite *hash_map_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create("Sharded Hash Map");
+
+    /* Core test case */
+    tc_core = tcase_create("Core");
+
+    tcase_add_checked_fixture(tc_core, setup_empty, teardown);
+    tcase_add_test(tc_core, test_hm_sharded_basic);
+    tcase_add_test(tc_core, test_hm_sharded_threads);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = hash_map_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,191 @@
+#include "../src/hm_snapshot.h"
+#include <check.h>
+#include <stdlib.h>
+
+#define KEYS 20000
+
+static hashmap_t *map;
+
+static void setup_filled(void)
+{
+    map = hm_create(
+        .key_size = sizeof(int),
+        .value_size = sizeof(long),
+        .hashfunc = hash_int
+    );
+
+    for (int i = 0; i < KEYS; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&map, &i, &(long){i}));
+    }
+}
+
+static void teardown(void)
+{
+    hm_destroy(map);
+}
+
+
+static int sum_values(const void *const key, const void *const value, void *const param)
+{
+    (void) key;
+    *(long*)param += *(const long*)value;
+    return 0;
+}
+
+
+static void assert_original(const hm_snapshot_t *const snapshot)
+{
+    ck_assert(hm_snapshot_valid(snapshot));
+    ck_assert_uint_eq(hm_snapshot_count(snapshot), KEYS);
+
+    for (int i = 0; i < KEYS; ++i)
+    {
+        const long *value = hm_snapshot_get(snapshot, &i);
+        ck_assert_ptr_nonnull(value);
+        ck_assert_int_eq(*value, i);
+    }
+    ck_assert_ptr_null(hm_snapshot_get(snapshot, &(int){-1}));
+
+    long sum = 0;
+    ck_assert_int_eq(0, hm_snapshot_foreach(snapshot, sum_values, &sum));
+    ck_assert_int_eq(sum, (long)KEYS * (KEYS - 1) / 2);
+}
+
+
+START_TEST (test_hm_snapshot_writes)
+{
+    hm_snapshot_t *snapshot = hm_snapshot(map);
+    ck_assert_ptr_nonnull(snapshot);
+
+    // writes of any kind leave the snapshot as it was taken
+    for (int i = 0; i < KEYS; i += 4)
+    {
+        ck_assert(hm_update(map, &i, &(long){-i}));
+    }
+    for (int i = 1; i < KEYS; i += 4)
+    {
+        hm_remove(map, &i);
+    }
+    for (int i = 2; i < KEYS; i += 4)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_upsert(&map, &i, &(long){0}));
+    }
+    hm_compact(map);
+    ck_assert_uint_eq(HM_SUCCESS, hm_insert(&map, &(int){-1}, &(long){1}));
+
+    hm_snapshot_t *second = hm_snapshot(map);
+    ck_assert_ptr_nonnull(second);
+    ck_assert_uint_eq(hm_snapshot_count(second), hm_count(map));
+
+    ck_assert_uint_eq(HM_SUCCESS, hm_upsert(&map, &(int){-1}, &(long){2}));
+
+    assert_original(snapshot);
+    ck_assert_int_eq(*(const long*)hm_snapshot_get(second, &(int){-1}), 1);
+    ck_assert_int_eq(*(const long*)hm_snapshot_get(second, &(int){4}), -4);
+    ck_assert_ptr_null(hm_snapshot_get(second, &(int){1}));
+
+    ck_assert_int_eq(*(const long*)hm_get(map, &(int){-1}), 2);
+    ck_assert_int_eq(*(const long*)hm_get(map, &(int){4}), -4);
+    ck_assert_ptr_null(hm_get(map, &(int){5}));
+
+    hm_snapshot_release(snapshot);
+    hm_snapshot_release(second);
+}
+END_TEST
+
+
+START_TEST (test_hm_snapshot_rehash)
+{
+    hm_snapshot_t *snapshot = hm_snapshot(map);
+    ck_assert_ptr_nonnull(snapshot);
+
+    // the map moves to other tables, snapshot keeps the one it shares
+    for (int i = KEYS; i < 8 * KEYS; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&map, &i, &(long){i}));
+    }
+    ck_assert_uint_eq(hm_count(map), 8 * KEYS);
+
+    assert_original(snapshot);
+
+    hm_destroy(map);
+    map = hm_create(.key_size = sizeof(int), .value_size = sizeof(long), .hashfunc = hash_int);
+
+    assert_original(snapshot);
+    hm_snapshot_release(snapshot);
+}
+END_TEST
+
+
+START_TEST (test_hm_snapshot_robin_hood)
+{
+    hashmap_t *rh = hm_create(
+        .key_size = sizeof(int),
+        .value_size = sizeof(long),
+        .hashfunc = hash_int,
+        .probing = HM_PROBING_ROBIN_HOOD,
+        .store_hash = true
+    );
+
+    for (int i = 0; i < KEYS; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&rh, &i, &(long){i}));
+    }
+
+    hm_snapshot_t *snapshot = hm_snapshot(rh);
+    ck_assert_ptr_nonnull(snapshot);
+
+    // backward shifts of removals move slots across chunks
+    for (int i = 0; i < KEYS; i += 2)
+    {
+        hm_remove(rh, &i);
+    }
+    for (int i = -KEYS; i < 0; ++i)
+    {
+        ck_assert_uint_eq(HM_SUCCESS, hm_insert(&rh, &i, &(long){i}));
+    }
+
+    assert_original(snapshot);
+    hm_snapshot_release(snapshot);
+    hm_destroy(rh);
+}
+END_TEST
+
+
+Suite *hash_map_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create("Hash Map Snapshots");
+
+    /* Core test case */
+    tc_core = tcase_create("Core");
+
+    tcase_add_checked_fixture(tc_core, setup_filled, teardown);
+    tcase_add_test(tc_core, test_hm_snapshot_writes);
+    tcase_add_test(tc_core, test_hm_snapshot_rehash);
+    tcase_add_test(tc_core, test_hm_snapshot_robin_hood);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = hash_map_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}